@@ -0,0 +1,319 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "checkers.h"
+
+namespace {
+
+typedef std::chrono::steady_clock steady_clock_t;
+
+// positions used to measure search speed
+const char * SEARCH_POSITIONS[] = {
+    "B:W21,22,23,24,25,26,27,28,29,30,31,32:B1,2,3,4,5,6,7,8,9,10,11,12",
+    "B:W18,19,21,23,24,26,29,30,31,32:B1,2,3,4,6,7,9,10,11,12",
+    "W:W17,21,22,23,25,26,27,29,31:B2,3,5,6,7,9,11,12,14",
+    "B:W14,19,22,26,27,30,K4:B3,6,10,11,16,20,K29",
+};
+const size_t NUM_SEARCH_POSITIONS =
+    sizeof(SEARCH_POSITIONS) / sizeof(SEARCH_POSITIONS[0]);
+
+// thread counts to measure scaling at
+const int32_t SEARCH_THREADS[] = {1, 2, 4, 8, 16};
+
+double seconds_since(steady_clock_t::time_point start)
+{
+    return std::chrono::duration<double>(steady_clock_t::now() - start).count();
+}
+
+// time to depth and nodes/sec for each thread count
+bool bench_search(int32_t depth, int32_t hash_mb)
+{
+    printf("search: depth %d, hash %dmb, %u hardware threads\n",
+           depth, hash_mb, std::thread::hardware_concurrency());
+    printf("threads      time      nodes    nodes/sec  speedup\n");
+    double base_time = 0.0;
+    for (const int32_t threads : SEARCH_THREADS) {
+        double time = 0.0;
+        uint64_t nodes = 0;
+        for (size_t i = 0; i < NUM_SEARCH_POSITIONS; ++i) {
+            bitboard_t bits;
+            colour_e turn;
+            if (!bits.from_fen(SEARCH_POSITIONS[i], turn)) {
+                printf("bad position '%s'\n", SEARCH_POSITIONS[i]);
+                return false;
+            }
+            // fresh search state so every run starts cold
+            search_t search;
+            search.set_hash_size(size_t(hash_mb));
+            search.set_threads(threads);
+            const search_limits_t limits = {depth, 0};
+            bitmove_t best;
+            search_info_t info;
+            const auto start = steady_clock_t::now();
+            if (!search.think(bits, turn, limits, best, info)) {
+                return false;
+            }
+            time += seconds_since(start);
+            nodes += info.nodes;
+        }
+        if (threads == 1) {
+            base_time = time;
+        }
+        printf("%7d %8.3fs %10llu %12.0f %7.2fx\n",
+               threads,
+               time,
+               (unsigned long long)nodes,
+               time > 0.0 ? double(nodes) / time : 0.0,
+               time > 0.0 ? base_time / time : 0.0);
+    }
+    return true;
+}
+
+// frames/sec of each 4x upscale this cpu can run, at the renderers size
+bool bench_upscale(int32_t frames)
+{
+    const uint32_t width = 154, height = 91;
+    const size_t dst_pitch = width * 4;
+    std::vector<uint32_t> src(width * height);
+    for (size_t i = 0; i < src.size(); ++i) {
+        src[i] = uint32_t(i * 2654435761u);
+    }
+    std::vector<uint32_t> expect(dst_pitch * height * 4);
+    std::vector<uint32_t> dst(expect.size());
+    upscale_t::get(upscale_t::SCALAR)(
+        src.data(), width, expect.data(), dst_pitch, width, height);
+    printf("upscale: %ux%u to %ux%u, %d frames\n",
+           width, height, width * 4, height * 4, frames);
+    printf("isa         time   frames/sec    MB/sec  speedup\n");
+    double base_time = 0.0;
+    bool valid = true;
+    for (int32_t isa = 0; isa < upscale_t::NUM_ISA; ++isa) {
+        const upscale_t::fn_t fn = upscale_t::get(upscale_t::isa_e(isa));
+        if (!fn) {
+            printf("%-6s  unsupported\n", upscale_t::name(upscale_t::isa_e(isa)));
+            continue;
+        }
+        std::fill(dst.begin(), dst.end(), 0);
+        const auto start = steady_clock_t::now();
+        for (int32_t i = 0; i < frames; ++i) {
+            fn(src.data(), width, dst.data(), dst_pitch, width, height);
+        }
+        const double time = seconds_since(start);
+        if (isa == upscale_t::SCALAR) {
+            base_time = time;
+        }
+        const bool ok = (dst == expect);
+        valid &= ok;
+        const double bytes = double(frames) * double(dst.size() * sizeof(uint32_t));
+        printf("%-6s %8.3fs %12.0f %9.0f %7.2fx%s\n",
+               upscale_t::name(upscale_t::isa_e(isa)),
+               time,
+               time > 0.0 ? double(frames) / time : 0.0,
+               time > 0.0 ? bytes / time / 1e6 : 0.0,
+               time > 0.0 ? base_time / time : 0.0,
+               ok ? "" : "  MISMATCH");
+    }
+    return valid;
+}
+
+// leaf positions/sec of each batch evaluation this cpu can run, over
+// positions reached by random play from the start
+bool bench_eval(int32_t batches)
+{
+    const size_t BATCH = 4096;
+    std::vector<bitboard_t> pos;
+    std::vector<colour_e> turn;
+    std::mt19937 random(1);
+    while (pos.size() < BATCH) {
+        board_t board;
+        board.reset();
+        bitboard_t bits = board.bits;
+        colour_e side = BLACK;
+        for (int32_t ply = 0; ply < 80 && pos.size() < BATCH; ++ply) {
+            move_list_t list;
+            if (!bits.generate(side, list) || list.size == 0) {
+                break;
+            }
+            bits.apply(list.move[random() % list.size], side);
+            side = (side == WHITE) ? BLACK : WHITE;
+            pos.push_back(bits);
+            turn.push_back(side);
+        }
+    }
+    std::vector<int32_t> expect(BATCH), out(BATCH);
+    for (size_t i = 0; i < BATCH; ++i) {
+        expect[i] = eval_t::evaluate(pos[i], turn[i]);
+    }
+    printf("eval: %d batches of %d positions\n", batches, int(BATCH));
+    printf("isa         time   positions/sec  speedup\n");
+    double base_time = 0.0;
+    bool valid = true;
+    for (int32_t isa = 0; isa < eval_t::NUM_ISA; ++isa) {
+        const eval_t::batch_fn_t fn = eval_t::get(eval_t::isa_e(isa));
+        if (!fn) {
+            printf("%-6s  unsupported\n", eval_t::name(eval_t::isa_e(isa)));
+            continue;
+        }
+        std::fill(out.begin(), out.end(), 0);
+        const auto start = steady_clock_t::now();
+        for (int32_t i = 0; i < batches; ++i) {
+            fn(pos.data(), turn.data(), BATCH, out.data());
+        }
+        const double time = seconds_since(start);
+        if (isa == eval_t::SCALAR) {
+            base_time = time;
+        }
+        const bool ok = (out == expect);
+        valid &= ok;
+        printf("%-6s %8.3fs %15.0f %7.2fx%s\n",
+               eval_t::name(eval_t::isa_e(isa)),
+               time,
+               time > 0.0 ? double(batches) * double(BATCH) / time : 0.0,
+               time > 0.0 ? base_time / time : 0.0,
+               ok ? "" : "  MISMATCH");
+    }
+    return valid;
+}
+
+// check that accumulators kept up to date move by move match ones built
+// from scratch, then time each inference kernel this cpu can run
+bool bench_nnue(const char * path, int32_t games)
+{
+    nnue_t net;
+    if (!net.open(path)) {
+        printf("unable to open network '%s'\n", path);
+        return false;
+    }
+    std::vector<bitboard_t> pos;
+    std::vector<colour_e> turn;
+    std::vector<nnue_t::accumulator_t> acc;
+    std::mt19937 random(1);
+    bool valid = true;
+    for (int32_t game = 0; game < games; ++game) {
+        board_t board;
+        board.reset();
+        colour_e side = BLACK;
+        nnue_t::accumulator_t from_moves, from_events, fresh;
+        net.refresh(board.bits, from_moves);
+        from_events = from_moves;
+        for (int32_t ply = 0; ply < 200; ++ply) {
+            move_list_t list;
+            if (!board.bits.generate(side, list) || list.size == 0) {
+                break;
+            }
+            const bitmove_t & m = list.move[random() % list.size];
+            const bitboard_t before = board.bits;
+            move_t move;
+            event_list_t events;
+            undo_t undo;
+            if (!m.to_move(move) || !board.make(move, side, events, undo)) {
+                printf("nnue: board rejected a generated move\n");
+                return false;
+            }
+            nnue_t::accumulator_t next;
+            net.update(from_moves, before, m, side, next);
+            from_moves = next;
+            net.update(from_events, before, events);
+            net.refresh(board.bits, fresh);
+            if (memcmp(&fresh, &from_moves, sizeof(fresh)) != 0 ||
+                memcmp(&fresh, &from_events, sizeof(fresh)) != 0) {
+                valid = false;
+            }
+            side = (side == WHITE) ? BLACK : WHITE;
+            pos.push_back(board.bits);
+            turn.push_back(side);
+            acc.push_back(fresh);
+        }
+    }
+    printf("nnue: %d positions, incremental updates %s\n",
+           int(pos.size()), valid ? "match" : "MISMATCH");
+    // inference
+    std::vector<int32_t> expect(pos.size()), out(pos.size());
+    printf("isa         time   positions/sec  speedup\n");
+    double base_time = 0.0;
+    const int32_t REPEAT = 200;
+    for (int32_t isa = 0; isa < eval_t::NUM_ISA; ++isa) {
+        if (!net.select(eval_t::isa_e(isa))) {
+            printf("%-6s  unsupported\n", eval_t::name(eval_t::isa_e(isa)));
+            continue;
+        }
+        const auto start = steady_clock_t::now();
+        for (int32_t r = 0; r < REPEAT; ++r) {
+            for (size_t i = 0; i < pos.size(); ++i) {
+                out[i] = net.evaluate(acc[i], turn[i]);
+            }
+        }
+        const double time = seconds_since(start);
+        if (isa == eval_t::SCALAR) {
+            base_time = time;
+            expect = out;
+        }
+        const bool ok = (out == expect);
+        valid &= ok;
+        printf("%-6s %8.3fs %15.0f %7.2fx%s\n",
+               eval_t::name(eval_t::isa_e(isa)),
+               time,
+               time > 0.0 ? double(REPEAT) * double(pos.size()) / time : 0.0,
+               time > 0.0 ? base_time / time : 0.0,
+               ok ? "" : "  MISMATCH");
+    }
+    return valid;
+}
+
+void usage()
+{
+    printf("usage: checkers_bench [options]\n");
+    printf("  -d <depth>      search depth (default 14)\n");
+    printf("  -hash <mb>      transposition table size (default 64)\n");
+    printf("  -upscale <n>    time n frames of the renderers upscale instead\n");
+    printf("  -eval <n>       time n batches of leaf evaluations instead\n");
+    printf("  -nnue <file>    check and time a network instead\n");
+}
+
+} // namespace {}
+
+int main(int argc, char * args[])
+{
+    int32_t depth = 14;
+    int32_t hash_mb = 64;
+    int32_t upscale_frames = 0;
+    int32_t eval_batches = 0;
+    const char * nnue_path = nullptr;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(args[i], "-d") == 0 && i+1 < argc) {
+            depth = atoi(args[++i]);
+        }
+        else if (strcmp(args[i], "-hash") == 0 && i+1 < argc) {
+            hash_mb = atoi(args[++i]);
+        }
+        else if (strcmp(args[i], "-upscale") == 0 && i+1 < argc) {
+            upscale_frames = atoi(args[++i]);
+        }
+        else if (strcmp(args[i], "-eval") == 0 && i+1 < argc) {
+            eval_batches = atoi(args[++i]);
+        }
+        else if (strcmp(args[i], "-nnue") == 0 && i+1 < argc) {
+            nnue_path = args[++i];
+        }
+        else {
+            usage();
+            return 1;
+        }
+    }
+    if (upscale_frames > 0) {
+        return bench_upscale(upscale_frames) ? 0 : 1;
+    }
+    if (nnue_path) {
+        return bench_nnue(nnue_path, 100) ? 0 : 1;
+    }
+    if (eval_batches > 0) {
+        return bench_eval(eval_batches) ? 0 : 1;
+    }
+    return bench_search(depth, hash_mb) ? 0 : 1;
+}
@@ -0,0 +1,200 @@
+#include "checkers.h"
+
+int32_t bitboard_t::square(const pos_t pos)
+{
+    // check the position is on the board
+    if (pos.x < 0 || pos.x > 7 ||
+        pos.y < 0 || pos.y > 7) {
+        return EMPTY;
+    }
+    // only black squares are playable
+    if ((pos.x & 1) != (pos.y & 1)) {
+        return EMPTY;
+    }
+    return pos.x/2 + pos.y*4;
+}
+
+pos_t bitboard_t::position(int32_t square)
+{
+    assert(square >= 0 && square < 32);
+    const int32_t y = square / 4;
+    const int32_t x = (square % 4) * 2 + (y & 1);
+    return pos_t{x, y};
+}
+
+bool bitboard_t::from_board(const board_t & board)
+{
+    white = black = kings = 0;
+    for (const piece_t & p : board.piece) {
+        // captured pieces are no longer on the board
+        if (p.type == CAPTURED) {
+            continue;
+        }
+        const int32_t sq = square(p.pos);
+        if (sq == EMPTY) {
+            assert(!"piece found on an unplayable square");
+            return false;
+        }
+        const uint32_t bit = 1u << sq;
+        // add to the owners mask
+        if (p.owner == WHITE) {
+            white |= bit;
+        }
+        else {
+            black |= bit;
+        }
+        // note if the piece is crowned
+        if (p.type == CROWNED) {
+            kings |= bit;
+        }
+    }
+    return true;
+}
+
+bool bitboard_t::to_board(board_t & out) const
+{
+    // squares cant be claimed by both sides and kings need an owner
+    if ((white & black) || (kings & ~(white | black))) {
+        return false;
+    }
+    // clear the board
+    out.board.fill(EMPTY);
+    // white pieces fill slots [0,12) and black pieces fill [12,24)
+    size_t next[2] = {0, 12};
+    for (int32_t sq = 0; sq < 32; ++sq) {
+        const uint32_t bit = 1u << sq;
+        if (!((white | black) & bit)) {
+            continue;
+        }
+        const colour_e owner = (white & bit) ? WHITE : BLACK;
+        size_t & index = next[owner];
+        // no more than 12 pieces per side
+        if (index >= size_t(owner == WHITE ? 12 : 24)) {
+            return false;
+        }
+        piece_t & p = out.piece[index];
+        p.owner = owner;
+        p.type = (kings & bit) ? CROWNED : SINGLE;
+        p.pos = position(sq);
+        out.board[p.pos.x + p.pos.y*8] = int32_t(index);
+        ++index;
+    }
+    // mark all unused slots as captured
+    for (; next[WHITE] < 12; ++next[WHITE]) {
+        out.piece[next[WHITE]] = piece_t{WHITE, CAPTURED, pos_t{-1, -1}};
+    }
+    for (; next[BLACK] < 24; ++next[BLACK]) {
+        out.piece[next[BLACK]] = piece_t{BLACK, CAPTURED, pos_t{-1, -1}};
+    }
+    // keep the mirror in step with the layout
+    out.bits = *this;
+    out.hash = zobrist_t::hash(*this);
+    return true;
+}
+
+bool bitboard_t::from_fen(const char * fen, colour_e & turn)
+{
+    white = black = kings = 0;
+    const char * c = fen;
+    // side to move
+    switch (*c++) {
+    case ('W'): turn = WHITE; break;
+    case ('B'): turn = BLACK; break;
+    default:
+        return false;
+    }
+    uint32_t * side = nullptr;
+    bool crowned = false;
+    int32_t number = 0, first = 0;
+    for (;; ++c) {
+        const char ch = *c;
+        // accumulate square numbers
+        if (ch >= '0' && ch <= '9') {
+            number = number*10 + (ch-'0');
+            continue;
+        }
+        // a dash marks a range of squares such as "1-12"
+        if (ch == '-') {
+            first = number;
+            number = 0;
+            continue;
+        }
+        // commit the squares that were just read
+        if (number) {
+            if (!side || number > 32 || first > number) {
+                return false;
+            }
+            for (int32_t n = first ? first : number; n <= number; ++n) {
+                const uint32_t bit = 1u << from_pdn(n);
+                *side |= bit;
+                kings |= crowned ? bit : 0;
+            }
+            number = first = 0;
+            crowned = false;
+        }
+        switch (ch) {
+        case ('\0'):
+        case ('.'):
+        case ('"'):
+            // squares cant be claimed by both sides
+            return (white & black) == 0;
+        case (':'):
+            side = nullptr;
+            break;
+        case ('W'):
+            side = &white;
+            break;
+        case ('B'):
+            side = &black;
+            break;
+        case ('K'):
+            crowned = true;
+            break;
+        case (','):
+        case (' '):
+            break;
+        default:
+            return false;
+        }
+    }
+}
+
+bool bitboard_t::to_fen(colour_e turn, std::string & out) const
+{
+    out = (turn == WHITE) ? "W" : "B";
+    const uint32_t side[2] = {white, black};
+    const char * name[2] = {":W", ":B"};
+    for (int32_t i = 0; i < 2; ++i) {
+        out += name[i];
+        bool first = true;
+        // list squares in PDN order
+        for (int32_t n = 1; n <= 32; ++n) {
+            const uint32_t bit = 1u << from_pdn(n);
+            if (!(side[i] & bit)) {
+                continue;
+            }
+            if (!first) {
+                out += ",";
+            }
+            first = false;
+            if (kings & bit) {
+                out += "K";
+            }
+            out += std::to_string(n);
+        }
+    }
+    return true;
+}
+
+uint32_t bitboard_t::checksum() const
+{
+    const uint32_t masks[3] = {white, black, kings};
+    uint32_t out = 2166136261u;
+    for (const uint32_t mask : masks) {
+        for (int32_t i = 0; i < 4; ++i) {
+            out ^= (mask >> (i * 8)) & 0xff;
+            out *= 16777619u;
+        }
+    }
+    return out;
+}
@@ -1,3 +1,5 @@
+#include <cstdlib>
+
 #include "checkers.h"
 
 bool board_t::reset()
@@ -25,11 +27,17 @@ bool board_t::reset()
         piece_t & p = piece[index];
         board[p.pos.x + p.pos.y*8] = index;
     }
+    // build the bitboard mirror
+    if (!bits.from_board(*this)) {
+        return false;
+    }
+    hash = zobrist_t::hash(bits);
     return true;
 }
 
 bool board_t::serialize(std::string &out) const
 {
+    METRIC_TIME(BOARD_SERIALIZE);
     // clear output string
     out.clear();
     // for each square on the board
@@ -82,7 +90,7 @@ bool board_t::get_piece(const pos_t pos, piece_t * & out)
     {
         const auto piece_index = board[index];
         if (piece_index==EMPTY) {
-            return nullptr;
+            return false;
         }
         out = &piece[piece_index];
     }
@@ -92,89 +100,158 @@ bool board_t::get_piece(const pos_t pos, piece_t * & out)
 bool board_t::move(const pos_t from,
                    const pos_t to,
                    const colour_e turn,
-                   std::deque<event_t> & events)
+                   event_list_t & events)
 {
-    // get piece that the player is moving
-    piece_t * piece = nullptr;
-    if (!get_piece(from, piece)) {
+    METRIC_TIME(BOARD_MOVE);
+    // find the squares being moved between
+    const int32_t src = bitboard_t::square(from);
+    const int32_t dst = bitboard_t::square(to);
+    if (src == EMPTY || dst == EMPTY) {
         return false;
     }
+    const uint32_t src_bit = 1u << src;
+    const uint32_t dst_bit = 1u << dst;
     // check player is only moving their peices
-    if (piece->owner!=turn) {
+    if (!(bits.pieces(turn) & src_bit)) {
         return false;
     }
     // check move destination is unoccupied
-    {
-        piece_t *dummy = nullptr;
-        if (get_piece(to, dummy)) {
-            return false;
-        }
-    }
-    // compute move differential
-    const int32_t dx = to.x - from.x;
-    const int32_t dy = to.y - from.y;
-    // piece must move on a pure diagonal
-    if (abs(dx)!=abs(dy)) {
-        return false;
-    }
-    // can only move only 1 square or 2 squares away if capturing
-    if (abs(dx) > 2) {
+    if (!(bits.empty() & dst_bit)) {
         return false;
     }
-    // there are special rules for uncrowned pieces
-    if (piece->type == SINGLE) {
-        switch (piece->owner) {
-        case (WHITE):
-            if (dy<0) {
-                // white must move downward only when uncrowned
-                return false;
-            }
-            break;
-        case (BLACK):
-            if (dy>0) {
-                // black must move upward only when uncrowned
-                return false;
-            }
-            break;
-        }
-        // check if piece has moved to opposite edge and can be crowned
-        if (to.y == (piece->owner==WHITE ? 7 : 0)) {
-            piece->type = CROWNED;
-            events.push_back(event_t{event_t::CROWN, to});
+    const colour_e other = (turn == WHITE) ? BLACK : WHITE;
+    const uint32_t opponent = bits.pieces(other);
+    const bool crowned = (bits.kings & src_bit) != 0;
+    // find all squares the piece can step or jump to
+    uint32_t steps = 0, jumps = 0;
+    for (int32_t d = 0; d < 4; ++d) {
+        const bitboard_t::dir_e dir = bitboard_t::dir_e(d);
+        // uncrowned pieces can only travel forward
+        if (!crowned && !bitboard_t::is_forward(turn, dir)) {
+            continue;
         }
+        const uint32_t near = bitboard_t::step(src_bit, dir);
+        steps |= near;
+        // a jump must pass over an opponents piece
+        jumps |= bitboard_t::step(near & opponent, dir);
     }
-    // if this is a capturing move
-    if (abs(dx) == 2) {
-        // find square that is being jumped
-        const pos_t mid = {(from.x+to.x)/2,
-                           (from.y+to.y)/2};
-        // try to find the piece that is being captured
-        piece_t * taken = nullptr;
-        if (!get_piece(mid, taken)) {
-            // no piece is being captured
-            return false;
-        }
-        // check for capture of same colour
-        if (taken->owner == piece->owner) {
-            // cant take your own pieces
-            return false;
-        }
-        // push capture into renderer event list
-        events.push_front(event_t{event_t::CAPTURE, {mid, mid}});
-        // remove captured piece
-        taken->type = CAPTURED;
-        taken->pos = pos_t{-1, -1};
-        board[mid.x + mid.y*8] = EMPTY;
+    // the only square adjacent to both ends of a jump is the one jumped
+    const uint32_t taken = (jumps & dst_bit) ?
+        (bitboard_t::neighbours(src_bit) &
+         bitboard_t::neighbours(dst_bit) & opponent) : 0;
+    // can only move 1 square or 2 squares away if capturing
+    if (!((steps | jumps) & dst_bit)) {
+        return false;
     }
     // push move event into renderer event list
-    events.push_front(event_t{event_t::MOVE, {from, to}});
+    events.push_back(event_t{event_t::MOVE, {from, to}});
     // update the board to reflect the movement
-    piece->pos = to;
     {
         const int32_t from_index = from.x + from.y*8;
         const int32_t to_index = to.x + to.y*8;
+        piece[board[from_index]].pos = to;
         board[to_index] = board[from_index];
         board[from_index] = EMPTY;
     }
+    bits.white ^= (turn == WHITE) ? (src_bit | dst_bit) : 0;
+    bits.black ^= (turn == BLACK) ? (src_bit | dst_bit) : 0;
+    if (crowned) {
+        bits.kings ^= src_bit | dst_bit;
+    }
+    hash ^= zobrist_t::piece(turn, crowned, src) ^
+            zobrist_t::piece(turn, crowned, dst);
+    // if this is a capturing move
+    if (taken) {
+        const pos_t mid = bitboard_t::position(bitboard_t::lsb(taken));
+        // push capture into renderer event list
+        events.push_back(event_t{event_t::CAPTURE, {mid, mid}});
+        // remove captured piece
+        const int32_t mid_index = mid.x + mid.y*8;
+        piece_t & p = piece[board[mid_index]];
+        p.type = CAPTURED;
+        p.pos = pos_t{-1, -1};
+        board[mid_index] = EMPTY;
+        hash ^= zobrist_t::piece(other,
+                                 (bits.kings & taken) != 0,
+                                 bitboard_t::lsb(taken));
+        bits.white &= ~taken;
+        bits.black &= ~taken;
+        bits.kings &= ~taken;
+    }
+    // check if piece has moved to opposite edge and can be crowned
+    if (!crowned && (dst_bit & bitboard_t::crown_row(turn))) {
+        piece[board[to.x + to.y*8]].type = CROWNED;
+        bits.kings |= dst_bit;
+        hash ^= zobrist_t::piece(turn, false, dst) ^
+                zobrist_t::piece(turn, true, dst);
+        events.push_back(event_t{event_t::CROWN, {to, to}});
+    }
     return true;
 }
+
+bool board_t::make(const move_t & move,
+                   const colour_e turn,
+                   event_list_t & events,
+                   undo_t & undo)
+{
+    if (move.size() < 2 || bitboard_t::square(move[0]) == EMPTY) {
+        return false;
+    }
+    undo.bits = bits;
+    undo.hash = hash;
+    undo.from = move[0];
+    undo.mover = board[move[0].x + move[0].y*8];
+    undo.taken.clear();
+    if (undo.mover == EMPTY) {
+        return false;
+    }
+    undo.type = piece[undo.mover].type;
+    // events of earlier hops are dropped if a later one is rejected
+    const size_t first_event = events.size();
+    for (size_t i=1; i<move.size(); ++i) {
+        const pos_t & from = move[i-1];
+        const pos_t & to = move[i];
+        // anything off the board is rejected before it is used as an index
+        if (bitboard_t::square(to) == EMPTY) {
+            unmake(undo);
+            events.truncate(first_event);
+            return false;
+        }
+        // remember the piece that a jump would remove
+        undo_t::capture_t capture = {EMPTY, piece_t()};
+        if (std::abs(to.x - from.x) == 2 && std::abs(to.y - from.y) == 2) {
+            const int32_t mid = (from.x + to.x)/2 + ((from.y + to.y)/2)*8;
+            capture.index = board[mid];
+            if (capture.index != EMPTY) {
+                capture.piece = piece[capture.index];
+            }
+        }
+        if (!this->move(from, to, turn, events)) {
+            unmake(undo);
+            events.truncate(first_event);
+            return false;
+        }
+        if (capture.index != EMPTY &&
+            piece[capture.index].type == CAPTURED) {
+            undo.taken.push_back(capture);
+        }
+    }
+    return true;
+}
+
+void board_t::unmake(const undo_t & undo)
+{
+    // return the moving piece to where it started
+    piece_t & p = piece[undo.mover];
+    board[p.pos.x + p.pos.y*8] = EMPTY;
+    board[undo.from.x + undo.from.y*8] = undo.mover;
+    p.pos = undo.from;
+    p.type = undo.type;
+    // put back everything it captured
+    for (const auto & c : undo.taken) {
+        piece[c.index] = c.piece;
+        board[c.piece.pos.x + c.piece.pos.y*8] = c.index;
+    }
+    bits = undo.bits;
+    hash = undo.hash;
+}
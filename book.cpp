@@ -0,0 +1,310 @@
+#if !defined(_MSC_VER)
+ #include <fcntl.h>
+ #include <sys/mman.h>
+ #include <sys/stat.h>
+ #include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#include "checkers.h"
+
+namespace {
+
+const char BOOK_MAGIC[4] = {'C', 'K', 'B', 'K'};
+// 2: entries hold the whole path of a move
+const uint32_t BOOK_VERSION = 2;
+
+// book file header, followed by entries sorted by key then move
+struct book_header_t
+{
+    char magic[4];
+    uint32_t version;
+    uint64_t entries;
+};
+
+// one move played from one position
+struct book_entry_t
+{
+    // zobrist_t::key of the position
+    uint64_t key;
+    // results of the games this move was played in, for the mover
+    uint32_t wins, draws, losses;
+    // chance of being picked, double the points the move has scored
+    uint16_t weight;
+    // the move as bitmove_t holds it, the whole path so that captures
+    // which start and end on the same squares are told apart
+    uint8_t from, hops;
+    std::array<uint8_t, bitmove_t::MAX_HOPS> path;
+    uint8_t pad[4];
+};
+static_assert(sizeof(book_entry_t) == 40, "book entries are stored raw");
+
+// a move seen while reading games
+struct sample_t
+{
+    uint64_t key;
+    uint8_t from, hops;
+    std::array<uint8_t, bitmove_t::MAX_HOPS> path;
+    // 0 loss, 1 draw, 2 win for the side that moved
+    uint8_t score;
+
+    bool operator < (const sample_t & rhs) const
+    {
+        if (key != rhs.key) {
+            return key < rhs.key;
+        }
+        if (from != rhs.from) {
+            return from < rhs.from;
+        }
+        if (hops != rhs.hops) {
+            return hops < rhs.hops;
+        }
+        return path < rhs.path;
+    }
+};
+
+bool same_move(const sample_t & a, const sample_t & b)
+{
+    return a.key == b.key && a.from == b.from && a.hops == b.hops &&
+           a.path == b.path;
+}
+
+bool same_move(const book_entry_t & e, const bitmove_t & m)
+{
+    return e.from == m.from && e.hops == m.hops &&
+           std::equal(m.path.begin(), m.path.begin() + m.hops, e.path.begin());
+}
+
+} // namespace {}
+
+struct book_t::impl_t
+{
+    void * base;
+    size_t size;
+    const book_entry_t * entries;
+    uint64_t count;
+
+    impl_t()
+        : base(nullptr)
+        , size(0)
+        , entries(nullptr)
+        , count(0)
+    {
+    }
+
+    ~impl_t()
+    {
+        close();
+    }
+
+    void close()
+    {
+#if !defined(_MSC_VER)
+        if (base) {
+            munmap(base, size);
+        }
+#endif
+        base = nullptr;
+        entries = nullptr;
+        size = count = 0;
+    }
+
+    bool open(const char * path)
+    {
+        close();
+#if defined(_MSC_VER)
+        return false;
+#else
+        const int fd = ::open(path, O_RDONLY);
+        if (fd < 0) {
+            return false;
+        }
+        struct stat st;
+        if (fstat(fd, &st) != 0 || size_t(st.st_size) < sizeof(book_header_t)) {
+            ::close(fd);
+            return false;
+        }
+        void * map = mmap(nullptr, size_t(st.st_size), PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (map == MAP_FAILED) {
+            return false;
+        }
+        const book_header_t * header = (const book_header_t *)map;
+        if (memcmp(header->magic, BOOK_MAGIC, 4) != 0 ||
+            header->version != BOOK_VERSION ||
+            size_t(st.st_size) < sizeof(book_header_t) +
+                                 header->entries * sizeof(book_entry_t)) {
+            log(LOG_WARN, "book: bad book file '%s'", path);
+            munmap(map, size_t(st.st_size));
+            return false;
+        }
+        base = map;
+        size = size_t(st.st_size);
+        entries = (const book_entry_t *)((const uint8_t *)map + sizeof(book_header_t));
+        count = header->entries;
+        return true;
+#endif
+    }
+
+    bool probe(const bitboard_t & pos,
+               colour_e turn,
+               uint32_t random,
+               bitmove_t & out) const
+    {
+        if (!entries) {
+            return false;
+        }
+        const uint64_t key = zobrist_t::key(pos, turn);
+        // binary search for the first entry of this position
+        const book_entry_t * first = std::lower_bound(
+            entries, entries + count, key,
+            [](const book_entry_t & e, uint64_t k) { return e.key < k; });
+        const book_entry_t * last = first;
+        uint32_t total = 0;
+        while (last != entries + count && last->key == key) {
+            total += last->weight;
+            ++last;
+        }
+        if (total == 0) {
+            return false;
+        }
+        // weighted pick among this positions moves
+        uint32_t pick = random % total;
+        const book_entry_t * chosen = first;
+        for (; chosen != last; ++chosen) {
+            if (pick < chosen->weight) {
+                break;
+            }
+            pick -= chosen->weight;
+        }
+        // the move must be legal here, which also guards against key
+        // collisions
+        move_list_t list;
+        if (chosen == last || !pos.generate(turn, list)) {
+            return false;
+        }
+        for (size_t i = 0; i < list.size; ++i) {
+            if (same_move(*chosen, list.move[i])) {
+                out = list.move[i];
+                return true;
+            }
+        }
+        return false;
+    }
+};
+
+book_t::book_t()
+    : imp_(new book_t::impl_t)
+{
+}
+
+book_t::~book_t()
+{
+    delete imp_;
+}
+
+bool book_t::open(const char * path)
+{
+    return imp_->open(path);
+}
+
+bool book_t::probe(const bitboard_t & pos,
+                   colour_e turn,
+                   uint32_t random,
+                   bitmove_t & out) const
+{
+    return imp_->probe(pos, turn, random, out);
+}
+
+bool book_t::build(const std::vector<const char *> & pdn_files,
+                   const char * path,
+                   int32_t max_plies,
+                   int32_t min_games)
+{
+    std::vector<sample_t> samples;
+    uint64_t games = 0, skipped = 0;
+    for (const char * file : pdn_files) {
+        pdn_reader_t reader;
+        if (!reader.open(file)) {
+            log(LOG_ERROR, "book: unable to open '%s'", file);
+            return false;
+        }
+        pdn_game_t game;
+        while (reader.next(game)) {
+            // only finished games say anything about a move
+            if (game.result == pdn_game_t::UNKNOWN) {
+                continue;
+            }
+            ++games;
+            bitboard_t pos = game.start;
+            colour_e turn = game.turn;
+            const size_t plies = std::min(game.moves.size(), size_t(max_plies));
+            for (size_t i = 0; i < plies; ++i) {
+                const bitmove_t & m = game.moves[i];
+                sample_t s;
+                s.key = zobrist_t::key(pos, turn);
+                s.from = m.from;
+                s.hops = m.hops;
+                // squares past the last hop are left zero so that equal
+                // moves compare equal
+                s.path.fill(0);
+                std::copy(m.path.begin(), m.path.begin() + m.hops, s.path.begin());
+                if (game.result == pdn_game_t::DRAW) {
+                    s.score = 1;
+                }
+                else {
+                    const bool white_won = game.result == pdn_game_t::WHITE_WIN;
+                    s.score = (white_won == (turn == WHITE)) ? 2 : 0;
+                }
+                samples.push_back(s);
+                pos.apply(m, turn);
+                turn = (turn == WHITE) ? BLACK : WHITE;
+            }
+        }
+        skipped += reader.skipped();
+    }
+    // merge repeated moves into one entry each
+    std::sort(samples.begin(), samples.end());
+    std::vector<book_entry_t> out;
+    for (size_t i = 0; i < samples.size();) {
+        book_entry_t e;
+        memset(&e, 0, sizeof(e));
+        e.key = samples[i].key;
+        e.from = samples[i].from;
+        e.hops = samples[i].hops;
+        e.path = samples[i].path;
+        size_t j = i;
+        for (; j < samples.size() && same_move(samples[i], samples[j]); ++j) {
+            e.wins += samples[j].score == 2;
+            e.draws += samples[j].score == 1;
+            e.losses += samples[j].score == 0;
+        }
+        i = j;
+        if (int64_t(e.wins) + e.draws + e.losses < min_games) {
+            continue;
+        }
+        e.weight = uint16_t(std::min<uint64_t>(2ull * e.wins + e.draws, 0xffff));
+        out.push_back(e);
+    }
+    FILE * fd = fopen(path, "wb");
+    if (!fd) {
+        log(LOG_ERROR, "book: unable to write '%s'", path);
+        return false;
+    }
+    book_header_t header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, BOOK_MAGIC, 4);
+    header.version = BOOK_VERSION;
+    header.entries = out.size();
+    bool ok = fwrite(&header, sizeof(header), 1, fd) == 1;
+    ok &= fwrite(out.data(), sizeof(book_entry_t), out.size(), fd) == out.size();
+    fclose(fd);
+    log("book: %llu games (%llu skipped), %llu entries",
+        (unsigned long long)games,
+        (unsigned long long)skipped,
+        (unsigned long long)out.size());
+    return ok;
+}
@@ -0,0 +1,49 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "checkers.h"
+
+namespace {
+
+void usage()
+{
+    printf("usage: checkers_book [options] <file.pdn ...>\n");
+    printf("  -o <file>     book file to write (default book.ckb)\n");
+    printf("  -plies <n>    plies of each game to learn from (default 16)\n");
+    printf("  -min <n>      games a move must appear in (default 2)\n");
+}
+
+} // namespace {}
+
+int main(int argc, char * args[])
+{
+    const char * out = "book.ckb";
+    int32_t plies = 16;
+    int32_t min_games = 2;
+    std::vector<const char *> files;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(args[i], "-o") == 0 && i+1 < argc) {
+            out = args[++i];
+        }
+        else if (strcmp(args[i], "-plies") == 0 && i+1 < argc) {
+            plies = atoi(args[++i]);
+        }
+        else if (strcmp(args[i], "-min") == 0 && i+1 < argc) {
+            min_games = atoi(args[++i]);
+        }
+        else if (args[i][0] == '-') {
+            usage();
+            return 1;
+        }
+        else {
+            files.push_back(args[i]);
+        }
+    }
+    if (files.empty()) {
+        usage();
+        return 1;
+    }
+    return book_t::build(files, out, plies, min_games) ? 0 : 1;
+}
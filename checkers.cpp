@@ -1,46 +1,88 @@
+#if defined(__linux__)
+ #include <poll.h>
+ #include <sys/eventfd.h>
+ #include <unistd.h>
+ #include <cerrno>
+#else
+ #include <chrono>
+ #include <thread>
+#endif
+
 #include "checkers.h"
 
+namespace {
+
+// plies between full board snapshots sent alongside the event stream
+const int32_t SNAPSHOT_PLIES = 16;
+
+} // namespace {}
+
 checkers_t::checkers_t(
         std::array<player_t*, 2> & p,
-        render_t * r)
+        render_t * r,
+        pdn_writer_t * w,
+        int32_t first)
     : player(p)
-    , render(r)
     , active(true)
+    , ply(0)
+    , render(r)
+    , wake_fd(-1)
+    , recorder(w)
+    , recorded(false)
 {
     // setup the starting board state
-    init();
+    init(first);
+}
+
+checkers_t::~checkers_t()
+{
+    // keep games cut short too, they just have no result
+    if (!recorded && ply > 0) {
+        finish(pdn_game_t::UNKNOWN);
+    }
+#if defined(__linux__)
+    if (wake_fd >= 0) {
+        close(wake_fd);
+    }
+#endif
 }
 
 bool checkers_t::apply_move(const move_t & move)
 {
-    // clone the board to try out this move
-    board_t clone = board;
-    // collect events for the renderer
-    std::deque<event_t> events;
-    // for each pair in the move list
-    for (size_t i=1; i<move.size(); ++i) {
-        // try to apply this move
-        if (!clone.move(move[i-1],
-                        move[i],
-                        player[0]->colour,
-                        events)) {
-            return false;
-        }
+    METRIC_TIME(APPLY_MOVE);
+    // list every legal move for the current player
+    move_list_t legal;
+    if (!board.bits.generate(player[0]->colour, legal)) {
+        assert(!"move list overflow");
+        return false;
     }
-    // move applies to clone becomes new board state
-    board = clone;
-    // feed generated events to the renderer
-    for (auto & event : events) {
-        render->push_event(event);
+    // reject anything that is not a complete legal move, which also
+    // enforces mandatory captures and full multi-jump sequences
+    const bitmove_t * found = legal.find(move);
+    if (!found) {
+        return false;
+    }
+    // collect events for the renderer and the opponent
+    events.clear();
+    // apply the move in place, the board is untouched if any hop fails
+    undo_t undo;
+    if (!board.make(move, player[0]->colour, events, undo)) {
+        assert(!"legal move rejected by the board");
+        return false;
+    }
+    game.moves.push_back(*found);
+    // feed generated events to the renderer in one go
+    if (render) {
+        render->push_events(events, board);
     }
     // success
     return true;
 }
 
-bool checkers_t::init_players()
+bool checkers_t::init_players(int32_t first)
 {
-    // randomize starting player
-    if (rand() & 1) {
+    // randomize starting player unless the host picked one
+    if (first < 0 ? (rand() & 1) != 0 : first == 1) {
         std::swap(player[0], player[1]);
     }
     // send colours to each player
@@ -52,23 +94,30 @@ bool checkers_t::init_players()
         player[0]->send_board(board);
         player[1]->send_board(board);
     }
+    // the record starts from whoever was picked to move first
+    game.start = board.bits;
+    game.turn = player[0]->colour;
+    game.moves.clear();
+    game.result = pdn_game_t::UNKNOWN;
     // ask player 0 to make their move
     player[0]->request_move();
     return true;
 }
 
-bool checkers_t::init()
+bool checkers_t::init(int32_t first)
 {
     if (!board.reset()) {
         assert(!"unable to reset the game board");
         return false;
     }
-    if (!init_players()) {
+    if (!init_players(first)) {
         assert(!"unable to init the players");
         return false;
     }
     // give the renderer our starting board state
-    render->set_pieces(board);
+    if (render) {
+        render->set_pieces(board);
+    }
     return true;
 }
 
@@ -80,16 +129,106 @@ bool checkers_t::is_active() const
 bool checkers_t::end()
 {
     active = false;
+#if defined(__linux__)
+    // release a game thread blocked in wait_players, one that has yet to
+    // create the eventfd sees active is clear before it blocks
+    const int fd = wake_fd;
+    const uint64_t one = 1;
+    if (fd >= 0 && write(fd, &one, sizeof(one)) != sizeof(one)) {
+        return false;
+    }
+#endif
+    return true;
+}
+
+bool checkers_t::wait_players()
+{
+#if defined(__linux__)
+    const int fd = player[0]->wait_fd();
+    if (fd < 0) {
+        return true;
+    }
+    // only games that block here need a way to be woken, server games are
+    // driven by epoll and never do
+    if (wake_fd < 0) {
+        wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (wake_fd < 0) {
+            return false;
+        }
+    }
+    // the player can make progress without waiting
+    if (!active) {
+        return true;
+    }
+    pollfd fds[4] = {
+        {fd, POLLIN, 0},
+        {wake_fd, POLLIN, 0},
+    };
+    nfds_t count = 2;
+    // also wake to send output a slow reader has left buffered
+    for (player_t * p : player) {
+        const int out = p->flush_fd();
+        if (out >= 0) {
+            fds[count++] = {out, POLLOUT, 0};
+        }
+    }
+    if (poll(fds, count, -1) < 0) {
+        return errno == EINTR;
+    }
+    // a player that failed here is caught by the next send or poll
+    for (player_t * p : player) {
+        p->flush();
+    }
     return true;
+#else
+    // no readiness notifications so give time back to the CPU
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    return true;
+#endif
+}
+
+bool checkers_t::player_ready() const
+{
+    return player[0]->wait_fd() < 0;
+}
+
+int32_t checkers_t::plies() const
+{
+    return ply;
+}
+
+const pdn_game_t & checkers_t::record() const
+{
+    return game;
+}
+
+void checkers_t::finish(pdn_game_t::result_e result)
+{
+    game.result = result;
+    // record before ending so a thread that sees the game end never
+    // records it a second time
+    if (!recorded) {
+        recorded = true;
+        if (recorder && !recorder->write(game)) {
+            log(LOG_ERROR, "unable to record game");
+        }
+    }
+    end();
 }
 
 bool checkers_t::poll_players()
 {
+    METRIC_TIME(POLL_PLAYERS);
     // request move from the current player
     move_t move;
     if (!player[0]->poll_move(move)) {
         // error polling the client for a move
         player[0]->bad_input();
+        // a player that has gone away forfeits the game
+        if (!player[0]->is_connected()) {
+            finish(player[1]->colour == WHITE ? pdn_game_t::WHITE_WIN :
+                                                pdn_game_t::BLACK_WIN);
+        }
         return false;
     }
     // bail out if no move was delivered (not yet ready)
@@ -102,18 +241,32 @@ bool checkers_t::poll_players()
         player[0]->invalid_move(move);
         return true;
     }
-    // send player the previous board state
-    if (!player[1]->send_move(move)) {
-        assert(!"error sending player opponent move");
+    ++ply;
+    // send the opponent the move and only what it changed, with a full
+    // board every so often so a player that has fallen out of sync can
+    // recover
+    const bool snapshot = ply % SNAPSHOT_PLIES == 0;
+    if (!player[1]->send_move(move) ||
+        !(snapshot ? player[1]->send_board(board) :
+                     player[1]->send_events(events, board))) {
+        // an opponent we can no longer reach forfeits the game
+        finish(player[0]->colour == WHITE ? pdn_game_t::WHITE_WIN :
+                                            pdn_game_t::BLACK_WIN);
         return false;
     }
-    // send the current board state
-    if (!player[1]->send_board(board)) {
-        assert(!"error sending player current board state");
+    // a player left without a legal move has lost
+    move_list_t replies;
+    if (board.bits.generate(player[1]->colour, replies) && replies.size == 0) {
+        finish(player[0]->colour == WHITE ? pdn_game_t::WHITE_WIN :
+                                            pdn_game_t::BLACK_WIN);
+        return true;
+    }
+    // request current move, from an opponent we can still reach
+    if (!player[1]->request_move()) {
+        finish(player[0]->colour == WHITE ? pdn_game_t::WHITE_WIN :
+                                            pdn_game_t::BLACK_WIN);
         return false;
     }
-    // request current move
-    player[1]->request_move();
     // swap current players turn
     std::swap(player[0], player[1]);
     return true;
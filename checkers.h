@@ -5,6 +5,8 @@
 #include <queue>
 #include <string>
 #include <array>
+#include <atomic>
+#include <chrono>
 
 static const int32_t EMPTY = -1;
 
@@ -37,8 +39,154 @@ struct piece_t
     pos_t pos;
 };
 
+// list with a fixed capacity stored inline, so building, copying and
+// popping one never touches the heap
+template <typename type_t, size_t CAPACITY>
+struct fixed_list_t
+{
+    typedef type_t * iterator;
+    typedef const type_t * const_iterator;
+
+    fixed_list_t()
+        : head_(0)
+        , tail_(0)
+    {
+    }
+
+    size_t size() const { return tail_ - head_; }
+    bool empty() const { return head_ == tail_; }
+    void clear() { head_ = tail_ = 0; }
+
+    type_t & operator [] (size_t i) { return items_[head_ + i]; }
+    const type_t & operator [] (size_t i) const { return items_[head_ + i]; }
+
+    type_t & front() { return items_[head_]; }
+    const type_t & front() const { return items_[head_]; }
+    type_t & back() { return items_[tail_ - 1]; }
+    const type_t & back() const { return items_[tail_ - 1]; }
+
+    iterator begin() { return items_.data() + head_; }
+    iterator end() { return items_.data() + tail_; }
+    const_iterator begin() const { return items_.data() + head_; }
+    const_iterator end() const { return items_.data() + tail_; }
+
+    // append an item, returns false if the list is full
+    bool push_back(const type_t & item)
+    {
+        if (tail_ == CAPACITY) {
+            if (head_ == 0) {
+                return false;
+            }
+            // reclaim the slots freed by pop_front
+            for (uint32_t i = head_; i < tail_; ++i) {
+                items_[i - head_] = items_[i];
+            }
+            tail_ -= head_;
+            head_ = 0;
+        }
+        items_[tail_++] = item;
+        return true;
+    }
+
+    void pop_front()
+    {
+        assert(!empty());
+        if (++head_ == tail_) {
+            head_ = tail_ = 0;
+        }
+    }
+
+    // drop items from the back until count are left
+    void truncate(size_t count)
+    {
+        assert(count <= size());
+        tail_ = head_ + uint32_t(count);
+        if (head_ == tail_) {
+            head_ = tail_ = 0;
+        }
+    }
+
+protected:
+    std::array<type_t, CAPACITY> items_;
+    uint32_t head_, tail_;
+};
+
+// bounded queue between one producer thread and one consumer thread,
+// neither of which ever locks, waits for the other or allocates
+template <typename type_t, size_t CAPACITY>
+struct spsc_ring_t
+{
+    static_assert((CAPACITY & (CAPACITY - 1)) == 0,
+                  "ring capacity must be a power of two");
+
+    spsc_ring_t()
+        : head_(0)
+        , tail_(0)
+    {
+    }
+
+    // slots the producer may fill (producer only)
+    size_t room() const
+    {
+        return CAPACITY - (tail_.load(std::memory_order_relaxed) -
+                           head_.load(std::memory_order_acquire));
+    }
+
+    // append all of some items or none of them (producer only)
+    bool push(const type_t * items, size_t count)
+    {
+        const size_t tail = tail_.load(std::memory_order_relaxed);
+        const size_t head = head_.load(std::memory_order_acquire);
+        if (CAPACITY - (tail - head) < count) {
+            return false;
+        }
+        for (size_t i = 0; i < count; ++i) {
+            items_[(tail + i) & (CAPACITY - 1)] = items[i];
+        }
+        // publish the items to the consumer
+        tail_.store(tail + count, std::memory_order_release);
+        return true;
+    }
+
+    bool push(const type_t & item)
+    {
+        return push(&item, 1);
+    }
+
+    // true if there is nothing to take (consumer only)
+    bool empty() const
+    {
+        return head_.load(std::memory_order_relaxed) ==
+               tail_.load(std::memory_order_acquire);
+    }
+
+    // take the oldest item (consumer only)
+    bool pop(type_t & out)
+    {
+        const size_t head = head_.load(std::memory_order_relaxed);
+        if (head == tail_.load(std::memory_order_acquire)) {
+            return false;
+        }
+        out = items_[head & (CAPACITY - 1)];
+        // hand the slot back to the producer
+        head_.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+protected:
+    // each end written by one side only, kept on separate cache lines
+    std::atomic<size_t> head_;
+    char pad0_[64 - sizeof(std::atomic<size_t>)];
+    std::atomic<size_t> tail_;
+    char pad1_[64 - sizeof(std::atomic<size_t>)];
+    std::array<type_t, CAPACITY> items_;
+};
+
+// most squares a move can visit, a start and up to 12 jump landings
+static const size_t MAX_MOVE_SQUARES = 16;
+
 struct move_t
-    : public std::deque<pos_t>
+    : public fixed_list_t<pos_t, MAX_MOVE_SQUARES>
 {
     bool serialize(std::string & out) const;
     bool pop(pos_t & out);
@@ -54,12 +202,336 @@ struct event_t {
     pos_t pos[2];
 };
 
+// most events one move can produce, a move and a capture per jump plus
+// a crowning
+static const size_t MAX_MOVE_EVENTS = 32;
+
+// events produced by one move, in the order they happened
+typedef fixed_list_t<event_t, MAX_MOVE_EVENTS> event_list_t;
+
+struct board_t;
+struct bitmove_t;
+struct move_list_t;
+
+// board packed as one bit per playable square
+//
+//  square index = x/2 + y*4, so each board row maps to one nibble and a
+//  diagonal step is a shift of 3, 4 or 5 bits depending on the row parity
+struct bitboard_t
+{
+    // squares occupied by white pieces
+    uint32_t white;
+    // squares occupied by black pieces
+    uint32_t black;
+    // squares occupied by crowned pieces of either colour
+    uint32_t kings;
+
+    // diagonal directions a piece can step in
+    enum dir_e {
+        UP_LEFT = 0,
+        UP_RIGHT,
+        DOWN_LEFT,
+        DOWN_RIGHT,
+    };
+
+    // squares on even rows (0, 2, 4, 6)
+    static const uint32_t EVEN_ROWS = 0x0f0f0f0fu;
+    // squares on odd rows (1, 3, 5, 7)
+    static const uint32_t ODD_ROWS = 0xf0f0f0f0u;
+    // even row squares with a neighbour to their left
+    static const uint32_t EVEN_LEFT = 0x0e0e0e0eu;
+    // odd row squares with a neighbour to their right
+    static const uint32_t ODD_RIGHT = 0x70707070u;
+    // rows on which white and black pieces are crowned
+    static const uint32_t WHITE_CROWN_ROW = 0xf0000000u;
+    static const uint32_t BLACK_CROWN_ROW = 0x0000000fu;
+
+    // map a board position to a square index (EMPTY if not playable)
+    static int32_t square(const pos_t);
+    // map a square index back to a board position
+    static pos_t position(int32_t square);
+
+    // map between square indices and standard PDN square numbers (1-32)
+    static int32_t from_pdn(int32_t number)
+    {
+        return (number-1) ^ 0x1c;
+    }
+    static int32_t to_pdn(int32_t square)
+    {
+        return (square ^ 0x1c) + 1;
+    }
+
+    // number of set bits in a mask
+    static int32_t count(uint32_t mask)
+    {
+#if defined(_MSC_VER)
+        return int32_t(__popcnt(mask));
+#else
+        return __builtin_popcount(mask);
+#endif
+    }
+
+    // index of the lowest set bit in a non zero mask
+    static int32_t lsb(uint32_t mask)
+    {
+        assert(mask);
+#if defined(_MSC_VER)
+        unsigned long index;
+        _BitScanForward(&index, mask);
+        return int32_t(index);
+#else
+        return __builtin_ctz(mask);
+#endif
+    }
+
+    // shift every square in a mask one diagonal step
+    static uint32_t step(uint32_t mask, dir_e dir)
+    {
+        switch (dir) {
+        case (UP_LEFT):
+            return ((mask & EVEN_LEFT) >> 5) | ((mask & ODD_ROWS) >> 4);
+        case (UP_RIGHT):
+            return ((mask & EVEN_ROWS) >> 4) | ((mask & ODD_RIGHT) >> 3);
+        case (DOWN_LEFT):
+            return ((mask & EVEN_LEFT) << 3) | ((mask & ODD_ROWS) << 4);
+        case (DOWN_RIGHT):
+            return ((mask & EVEN_ROWS) << 4) | ((mask & ODD_RIGHT) << 5);
+        }
+        return 0;
+    }
+
+    // the direction opposite to another
+    static dir_e reverse(dir_e dir)
+    {
+        return dir_e(3 - int32_t(dir));
+    }
+
+    // squares one diagonal step away in any direction
+    static uint32_t neighbours(uint32_t mask)
+    {
+        return step(mask, UP_LEFT)   | step(mask, UP_RIGHT) |
+               step(mask, DOWN_LEFT) | step(mask, DOWN_RIGHT);
+    }
+
+    // check if uncrowned pieces of a colour may travel in a direction
+    static bool is_forward(colour_e c, dir_e dir)
+    {
+        return (c==WHITE) ? (dir >= DOWN_LEFT) : (dir <= UP_RIGHT);
+    }
+
+    // row on which a colour is crowned
+    static uint32_t crown_row(colour_e c)
+    {
+        return (c==WHITE) ? WHITE_CROWN_ROW : BLACK_CROWN_ROW;
+    }
+
+    // squares occupied by one side
+    uint32_t pieces(colour_e c) const
+    {
+        return (c==WHITE) ? white : black;
+    }
+
+    // squares occupied by neither side
+    uint32_t empty() const
+    {
+        return ~(white | black);
+    }
+
+    bool operator == (const bitboard_t & rhs) const {
+        return white==rhs.white && black==rhs.black && kings==rhs.kings;
+    }
+
+    // FNV-1a over the little endian white, black and kings masks, simple
+    // enough for clients to recompute when checking they are in sync
+    uint32_t checksum() const;
+
+    // pack the pieces of a board
+    bool from_board(const board_t &);
+    // expand into board layout and piece records
+    bool to_board(board_t &) const;
+
+    // parse a PDN FEN string such as "B:W21,22,K3:B1,2,3"
+    bool from_fen(const char * fen, colour_e & turn);
+    // write out as a PDN FEN string
+    bool to_fen(colour_e turn, std::string & out) const;
+
+    // pieces of a side that are able to make a capture
+    uint32_t jumpers(colour_e turn) const;
+    // write every legal move for a side into a list
+    bool generate(colour_e turn, move_list_t & out) const;
+    // apply a move produced by generate()
+    void apply(const bitmove_t & move, colour_e turn);
+};
+
+// compact move as produced by the move generator
+struct bitmove_t
+{
+    // a piece can capture at most 12 times in one move
+    static const size_t MAX_HOPS = 12;
+
+    // square the moving piece starts on
+    uint8_t from;
+    // number of squares landed on
+    uint8_t hops;
+    // squares landed on in order, the last being the destination
+    std::array<uint8_t, MAX_HOPS> path;
+    // mask of squares captured by this move
+    uint32_t taken;
+
+    // square the moving piece finishes on
+    uint8_t to() const {
+        assert(hops > 0);
+        return path[hops-1];
+    }
+
+    bool operator == (const bitmove_t & rhs) const {
+        if (from!=rhs.from || hops!=rhs.hops || taken!=rhs.taken) {
+            return false;
+        }
+        for (size_t i = 0; i < hops; ++i) {
+            if (path[i]!=rhs.path[i]) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // expand into a list of board positions
+    bool to_move(move_t & out) const;
+    // check if this is the same move as a list of board positions
+    bool matches(const move_t & move) const;
+};
+
+static_assert(bitmove_t::MAX_HOPS + 1 <= MAX_MOVE_SQUARES,
+              "move_t must hold the longest multi-jump");
+static_assert(bitmove_t::MAX_HOPS * 2 + 1 <= MAX_MOVE_EVENTS,
+              "event_list_t must hold the events of the longest multi-jump");
+
+
+// fixed capacity list of legal moves
+struct move_list_t
+{
+    static const size_t MAX_MOVES = 128;
+
+    std::array<bitmove_t, MAX_MOVES> move;
+    size_t size;
+
+    move_list_t()
+        : size(0)
+    {
+    }
+
+    // find the listed move matching a list of board positions
+    const bitmove_t * find(const move_t & move) const;
+};
+
+// random keys used to hash positions
+struct zobrist_t
+{
+    // keys indexed by [colour][crowned][square]
+    static uint64_t keys[2][2][32];
+    // key toggled when black is to move
+    static uint64_t side_key;
+
+    // key for one piece on a square
+    static uint64_t piece(colour_e c, bool crowned, int32_t square)
+    {
+        return keys[c][crowned ? 1 : 0][square];
+    }
+    // hash of every piece on a board, excluding the side to move
+    static uint64_t hash(const bitboard_t &);
+    // hash of a position including the side to move
+    static uint64_t key(const bitboard_t & bits, colour_e turn)
+    {
+        return hash(bits) ^ (turn == BLACK ? side_key : 0);
+    }
+    // change in hash made by a move, including the change of turn
+    static uint64_t delta(const bitboard_t & before,
+                          const bitmove_t & move,
+                          colour_e turn);
+};
+
+// fixed size hash table of search results shared between threads
+struct tt_t
+{
+    enum bound_e {
+        NONE = 0,
+        EXACT,
+        LOWER,
+        UPPER,
+    };
+
+    // unpacked table entry
+    struct hit_t
+    {
+        int32_t depth;
+        bound_e bound;
+        int32_t score;
+        // best move start and destination squares
+        uint8_t from, to;
+    };
+
+    tt_t();
+    ~tt_t();
+    // reallocate the table to fit within a number of megabytes
+    bool resize(size_t mb);
+    // wipe all entries
+    void clear();
+    // advance the age used to replace stale entries
+    void new_search();
+    // look up a position
+    bool probe(uint64_t key, hit_t & out) const;
+    // save a search result for a position
+    void store(uint64_t key, const hit_t & in);
+
+protected:
+    // entries are validated by storing key ^ data so a torn write from
+    // two threads racing on the same slot is detected as a miss
+    struct entry_t
+    {
+        std::atomic<uint64_t> check;
+        std::atomic<uint64_t> data;
+    };
+    // four entries fill one cache line
+    static const size_t BUCKET_SIZE = 4;
+
+    entry_t * entries;
+    // number of buckets minus one (always a power of two minus one)
+    size_t mask;
+    uint8_t age;
+};
+
+// what board_t::make changed, so board_t::unmake can put it back
+struct undo_t
+{
+    // a piece removed by the move and the board index it came from
+    struct capture_t
+    {
+        int32_t index;
+        piece_t piece;
+    };
+
+    // bitboard mirror and hash before the move
+    bitboard_t bits;
+    uint64_t hash;
+    // index of the piece that moved, where it started and its type then
+    int32_t mover;
+    pos_t from;
+    piece_state_e type;
+    // pieces captured along the way
+    fixed_list_t<capture_t, 12> taken;
+};
+
 struct board_t
 {
     // board layout
     std::array<int32_t, 8*8> board;
     // board pieces (12 * {white, black})
     std::array<piece_t, 12*2> piece;
+    // bitboard mirror of the board layout
+    bitboard_t bits;
+    // zobrist hash of the pieces on the board
+    uint64_t hash;
 
     bool serialize(std::string & out) const;
 
@@ -71,7 +543,16 @@ struct board_t
     bool move(const pos_t from,
               const pos_t to,
               const colour_e turn,
-              std::deque<event_t> & events);
+              event_list_t & events);
+
+    // apply every hop of a move in place, recording how to take it back;
+    // a hop the board rejects leaves the board as it was
+    bool make(const move_t & move,
+              const colour_e turn,
+              event_list_t & events,
+              undo_t & undo);
+    // restore the board to how it was before make
+    void unmake(const undo_t & undo);
 
     bool get_piece(const pos_t, piece_t * &out);
 };
@@ -80,6 +561,7 @@ struct player_t
 {
     const colour_e colour;
     player_t(colour_e c) : colour(c) {}
+    virtual ~player_t() {}
 
     // query if the player is currently connected
     virtual bool is_connected() = 0;
@@ -91,56 +573,195 @@ struct player_t
     virtual bool send_move(const move_t & move) = 0;
     // send the entire board state
     virtual bool send_board(const board_t & board) = 0;
+    // send the events the opponents move produced, players that cannot
+    // replay events may use the resulting board instead
+    virtual bool send_events(const event_list_t & events,
+                             const board_t & board) = 0;
     // send the player their colour
     virtual bool send_colour(colour_e) = 0;
     // tell the player to begin their turn
     virtual bool request_move() = 0;
     // tell the player they sent over bad input
     virtual bool bad_input() = 0;
+    // descriptor that becomes readable once poll_move may make progress,
+    // or -1 if poll_move should be called again without waiting
+    virtual int wait_fd() { return -1; }
+    // send output still buffered for a slow reader, false once the player
+    // has gone away
+    virtual bool flush() { return true; }
+    // descriptor that becomes writable once flush may make progress, or
+    // -1 if nothing is waiting to be sent
+    virtual int flush_fd() { return -1; }
 };
 
 struct render_t
 {
+    virtual ~render_t() {}
     // start the renderer
     virtual bool init() = 0;
     // per frame renderer update
     virtual bool tick() = 0;
     // add a board event to the renderers event queue
     virtual bool push_event(const event_t & event) = 0;
+    // add every event of one move at once, a renderer that has fallen
+    // behind may jump to the resulting board instead
+    virtual bool push_events(const event_list_t & events,
+                             const board_t & board)
+    {
+        for (const event_t & event : events) {
+            if (!push_event(event)) {
+                return false;
+            }
+        }
+        return true;
+    }
     // set piece and board state
     virtual bool set_pieces(const board_t & board) = 0;
 };
 
+// hands out a renderer per game to hosts running many games at once
+struct render_pool_t
+{
+    virtual ~render_pool_t() {}
+    // start the pool
+    virtual bool init() = 0;
+    // per frame update of every game, false once the pool should close
+    virtual bool tick() = 0;
+    // renderer for a new game, or nullptr if there is no room (safe from
+    // any thread)
+    virtual render_t * acquire() = 0;
+    // hand back a renderer once its game is over (safe from any thread)
+    virtual void release(render_t * render) = 0;
+};
+
+// a game read from or written to a PDN file
+struct pdn_game_t
+{
+    enum result_e {
+        UNKNOWN = 0,
+        WHITE_WIN,
+        BLACK_WIN,
+        DRAW,
+    };
+
+    // position the game started from
+    bitboard_t start;
+    colour_e turn;
+    // moves in the order they were played
+    std::vector<bitmove_t> moves;
+    result_e result;
+};
+
+// streams games out of a PDN file
+struct pdn_reader_t
+{
+    pdn_reader_t();
+    ~pdn_reader_t();
+    bool open(const char * path);
+    // read the next game, returns false once the file is exhausted
+    bool next(pdn_game_t & out);
+    // games dropped because a move could not be followed
+    uint64_t skipped() const;
+protected:
+    struct impl_t;
+    impl_t * imp_;
+};
+
+// appends finished games to a PDN file from a background thread, so the
+// threads playing games never wait on the disk
+struct pdn_writer_t
+{
+    pdn_writer_t();
+    ~pdn_writer_t();
+    // open a file to append to and start the writer thread
+    bool open(const char * path);
+    // queue a game to be written (safe from any thread)
+    bool write(const pdn_game_t & game);
+    // write out every queued game and close the file
+    void close();
+    // games written to disk so far
+    uint64_t written() const;
+
+    // format a game as PDN movetext with its tags
+    static bool format(const pdn_game_t & game,
+                       uint64_t round,
+                       std::string & out);
+protected:
+    struct impl_t;
+    impl_t * imp_;
+};
+
 struct checkers_t
 {
-    // ctor
+    // ctor, finished games are written to the recorder if one is given.
+    // first is the index of the player to move first, or -1 to pick one
+    // at random
     checkers_t(std::array<player_t*, 2> &,
-               render_t *);
+               render_t *,
+               pdn_writer_t * recorder = nullptr,
+               int32_t first = -1);
+    ~checkers_t();
     // is the game currently active
     bool is_active() const;
     // poll the players for moves
     bool poll_players();
-    // end the game
+    // true if the current player already has input for us, so polling
+    // again makes progress without waiting
+    bool player_ready() const;
+    // block until the current player may have a move for us or the
+    // game has ended
+    bool wait_players();
+    // end the game (safe from any thread)
     bool end();
+    // number of moves played so far
+    int32_t plies() const;
+    // the game so far, with its result once it is over
+    const pdn_game_t & record() const;
 
 protected:
-    bool init_players();
-    bool init();
+    bool init_players(int32_t first);
+    bool init(int32_t first);
     bool apply_move(const move_t &);
+    // end the game with a result and hand it to the recorder
+    void finish(pdn_game_t::result_e result);
 
     // the current board state
     board_t board;
+    // events produced by the last move applied
+    event_list_t events;
     // connected players
     std::array<player_t*, 2> player;
-    bool active;
+    std::atomic<bool> active;
+    // moves played so far
+    int32_t ply;
+    // board renderer (may be nullptr)
     render_t * render;
+    // signalled by end() to release wait_players(), created the first
+    // time a game waits there
+    std::atomic<int> wake_fd;
+    // every move played, for the recorder
+    pdn_game_t game;
+    pdn_writer_t * recorder;
+    bool recorded;
+};
+
+// wire formats a tcp client may speak
+enum protocol_e
+{
+    // ascii boards and digit pair moves
+    PROTOCOL_TEXT = 0,
+    // length prefixed binary frames (see tcp_player.cpp)
+    PROTOCOL_BINARY,
+    // asked for a binary version we do not speak, the client has been
+    // told and should be closed
+    PROTOCOL_REJECTED,
 };
 
 struct tcp_factory_t
 {
     tcp_factory_t();
     ~tcp_factory_t();
-    bool start();
+    bool start(const char * address, uint16_t port);
     bool stop();
     player_t * new_tcp_player(colour_e clr);
 protected:
@@ -148,7 +769,366 @@ protected:
     impl_t * imp_;
 };
 
+// hosts many games at once, pairing clients into matches as they connect
+struct tcp_server_t
+{
+    tcp_server_t();
+    ~tcp_server_t();
+    // open the listen socket
+    bool start(const char * address, uint16_t port);
+    // append every finished game to a PDN file
+    bool record(const char * pdn_path);
+    // draw games with renderers from a pool while it has room
+    bool spectate(render_pool_t * pool);
+    // run the event loop until stop is called
+    bool run();
+    // ask the event loop to exit (safe from any thread)
+    bool stop();
+protected:
+    struct impl_t;
+    impl_t * imp_;
+};
+
+// limits placed on a search
+struct search_limits_t
+{
+    // maximum depth in plies
+    int32_t depth;
+    // time budget in milliseconds (0 for no limit)
+    int32_t time_ms;
+};
+
+// summary of the last completed search iteration
+struct search_info_t
+{
+    int32_t depth;
+    int32_t score;
+    uint64_t nodes;
+    int32_t time_ms;
+};
+
+// endgame tablebase probed through memory mapped slice files
+struct tablebase_t
+{
+    enum result_e {
+        DRAW = 0,
+        WIN,
+        LOSS,
+    };
+
+    tablebase_t();
+    ~tablebase_t();
+    // map every slice file in a directory with up to a number of pieces
+    bool open(const char * dir, int32_t max_pieces);
+    // largest piece count of any mapped slice
+    int32_t pieces() const;
+    // look up a position from the side to move's point of view, with the
+    // distance in plies to the end of the game
+    bool probe(const bitboard_t & pos,
+               colour_e turn,
+               result_e & result,
+               int32_t & distance) const;
+
+    // solve every slice with up to a number of pieces into a directory
+    static bool build(const char * dir, int32_t max_pieces, int32_t threads);
+
+    struct impl_t;
+protected:
+    impl_t * imp_;
+};
+
+// opening moves played from positions in recorded games, in a sorted
+// memory mapped file
+struct book_t
+{
+    book_t();
+    ~book_t();
+    bool open(const char * path);
+    // pick a book move at random, weighted towards moves that scored well
+    bool probe(const bitboard_t & pos,
+               colour_e turn,
+               uint32_t random,
+               bitmove_t & out) const;
+
+    // build a book from the first plies of every game in some PDN files
+    static bool build(const std::vector<const char *> & pdn_files,
+                      const char * path,
+                      int32_t max_plies,
+                      int32_t min_games);
+
+protected:
+    struct impl_t;
+    impl_t * imp_;
+};
+
+// settings for an engine player
+struct engine_config_t
+{
+    search_limits_t limits;
+    // transposition table size in megabytes
+    int32_t hash_mb;
+    // number of search threads
+    int32_t threads;
+    // directory of endgame tablebase files (may be nullptr)
+    const char * tb_path;
+    // largest tablebase piece count to load
+    int32_t tb_pieces;
+    // opening book file (may be nullptr)
+    const char * book_path;
+    // skip logging a line per move
+    bool quiet;
+    // evaluation network file, the hand written evaluation is used
+    // without one (may be nullptr)
+    const char * nnue_path;
+};
+
+struct nnue_t;
+
+struct search_t
+{
+    search_t();
+    ~search_t();
+    // size the transposition table in megabytes
+    bool set_hash_size(size_t mb);
+    // number of threads to search with
+    bool set_threads(int32_t count);
+    // endgame tablebase to probe (may be nullptr)
+    bool set_tablebase(const tablebase_t * tb);
+    // network to evaluate leaves with (may be nullptr)
+    bool set_network(const nnue_t * net);
+    // abort a search in progress from another thread
+    void stop();
+    // find the best move for the side to move
+    bool think(const bitboard_t & pos,
+               colour_e turn,
+               const search_limits_t & limits,
+               bitmove_t & best,
+               search_info_t & info);
+protected:
+    struct impl_t;
+    impl_t * imp_;
+};
+
+// instruction sets kernels are picked between at runtime, false on cpus
+// (or builds) that cannot run them
+struct cpu_t
+{
+    static bool sse2();
+    static bool avx2();
+};
+
+// static evaluation of a position from the point of view of the side to
+// move: material, kings, back rank, advancement, mobility, centre control
+// and tempo. batches of positions are scored with the widest kernel the
+// cpu has.
+struct eval_t
+{
+    enum isa_e {
+        SCALAR = 0,
+        AVX2,
+        NUM_ISA,
+    };
+
+    static int32_t evaluate(const bitboard_t & pos, colour_e turn);
+
+    // score count positions, out[i] from the point of view of turn[i]
+    typedef void (*batch_fn_t)(const bitboard_t * pos,
+                               const colour_e * turn,
+                               size_t count,
+                               int32_t * out);
+
+    // an implementation, or nullptr if this cpu cannot run it
+    static batch_fn_t get(isa_e isa);
+    // fastest implementation this cpu can run
+    static batch_fn_t best();
+    static const char * name(isa_e isa);
+};
+
+// quantized evaluation network read from a memory mapped file
+//
+//  features are the 128 (piece type, square) pairs, seen from each side
+//  with the board turned around for black. each side's view goes through
+//  a 128 wide int16 first layer, the accumulator, which is kept up to date
+//  by adding and removing the weights of the features a move changes.
+//  both views, side to move first, are clipped to int8 and pass through a
+//  32 wide int8 layer and a single int8 output.
+struct nnue_t
+{
+    static const size_t FEATURES = 128;
+    static const size_t HIDDEN = 128;
+    static const size_t L2 = 32;
+    // fixed point scales of the first layer and of the later weights
+    static const int32_t QA = 127;
+    static const int32_t QB = 64;
+    // output units per man, the network is trained in men
+    static const int32_t SCALE = 100;
+
+    // the weights exactly as stored in a network file
+    struct weights_t
+    {
+        int16_t l1_weight[FEATURES][HIDDEN];
+        int16_t l1_bias[HIDDEN];
+        int8_t l2_weight[L2][2*HIDDEN];
+        int32_t l2_bias[L2];
+        int8_t l3_weight[L2];
+        int32_t l3_bias;
+    };
+
+    // first layer output from both sides point of view, indexed by colour
+    struct accumulator_t
+    {
+        int16_t v[2][HIDDEN];
+    };
+
+    nnue_t();
+    ~nnue_t();
+    bool open(const char * path);
+    // pick a kernel, false if this cpu cannot run it
+    bool select(eval_t::isa_e isa);
+
+    // build an accumulator from scratch
+    void refresh(const bitboard_t & pos, accumulator_t & out) const;
+    // the accumulator after a move, touching only the features it changes
+    void update(const accumulator_t & parent,
+                const bitboard_t & pos,
+                const bitmove_t & move,
+                colour_e turn,
+                accumulator_t & out) const;
+    // follow the events board_t produced for a move from a position
+    void update(accumulator_t & acc,
+                const bitboard_t & before,
+                const event_list_t & events) const;
+    // score from the point of view of the side to move
+    int32_t evaluate(const accumulator_t & acc, colour_e turn) const;
+
+    static bool save(const char * path, const weights_t & weights);
+
+    struct impl_t;
+protected:
+    impl_t * imp_;
+};
+
+// nearest neighbour 4x upscale of 32 bit pixels, with the best
+// implementation for the cpu picked at runtime
+struct upscale_t
+{
+    enum isa_e {
+        SCALAR = 0,
+        SSE2,
+        AVX2,
+        NUM_ISA,
+    };
+
+    // pitches are in pixels, dst must hold width*4 x height*4 pixels
+    typedef void (*fn_t)(const uint32_t * src,
+                         size_t src_pitch,
+                         uint32_t * dst,
+                         size_t dst_pitch,
+                         uint32_t width,
+                         uint32_t height);
+
+    // an implementation, or nullptr if this cpu cannot run it
+    static fn_t get(isa_e isa);
+    // fastest implementation this cpu can run
+    static fn_t best();
+    static const char * name(isa_e isa);
+};
+
+// counters and latency histograms for the hot paths, kept per thread and
+// merged when read. build without CHECKERS_METRICS and the METRIC_ macros
+// compile to nothing.
+struct metrics_t
+{
+    enum counter_e {
+        TCP_SENT_BYTES = 0,
+        TCP_RECV_BYTES,
+        NUM_COUNTERS,
+    };
+
+    enum timer_e {
+        POLL_PLAYERS = 0,
+        APPLY_MOVE,
+        BOARD_MOVE,
+        BOARD_SERIALIZE,
+        NUM_TIMERS,
+    };
+
+    static void add(counter_e counter, uint64_t value);
+    static void record(timer_e timer, uint64_t ns);
+    // every metric in the prometheus text exposition format
+    static void format(std::string & out);
+    // rewrite a file with the current metrics every period until stopped
+    static bool start_dump(const char * path, int32_t period_ms);
+    static void stop_dump();
+};
+
+// times the enclosing scope into one of the metrics_t timers
+struct metric_timer_t
+{
+    metric_timer_t(metrics_t::timer_e timer)
+        : timer_(timer)
+        , start_(std::chrono::steady_clock::now())
+    {
+    }
+
+    ~metric_timer_t()
+    {
+        const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start_).count();
+        metrics_t::record(timer_, uint64_t(ns));
+    }
+
+protected:
+    metrics_t::timer_e timer_;
+    std::chrono::steady_clock::time_point start_;
+};
+
+#if defined(CHECKERS_METRICS)
+ #define METRIC_TIME(timer) metric_timer_t metric_timer_(metrics_t::timer)
+ #define METRIC_ADD(counter, value) metrics_t::add(metrics_t::counter, (value))
+#else
+ #define METRIC_TIME(timer)
+ #define METRIC_ADD(counter, value)
+#endif
+
 extern player_t * new_stdio_player(colour_e);
+extern player_t * new_tcp_player(colour_e, intptr_t socket, protocol_e);
+// look at the first bytes a client sent to pick its wire format, returns
+// false while it is still too early to tell
+extern bool detect_protocol(intptr_t socket, protocol_e & out);
+extern player_t * new_engine_player(colour_e, const engine_config_t &);
 extern render_t * new_sdl_render();
+// renderer that discards everything, for machines without a display
+extern render_t * new_null_render();
+// renderer that writes the event stream to a text file
+extern render_t * new_record_render(const char * path);
+// window tiling up to a number of games, redrawing only what changes
+extern render_pool_t * new_sdl_spectator(int32_t boards);
 
+enum log_level_e {
+    LOG_DEBUG,
+    LOG_INFO,
+    LOG_WARN,
+    LOG_ERROR,
+};
+
+// queue a message for the log thread, never blocks and drops the message
+// if this threads buffer is full. the first form logs at LOG_INFO.
 void log(const char * fmt, ...);
+void log(log_level_e level, const char * fmt, ...);
+// messages below this level are discarded before formatting
+void log_set_level(log_level_e level);
+// block until every message queued so far has been written, before
+// sharing the console with the log
+void log_flush();
+
+// tags messages logged on this thread with a game and connection id
+// until it goes out of scope (zero for none)
+struct log_scope_t
+{
+    log_scope_t(uint32_t game, uint32_t conn);
+    ~log_scope_t();
+
+protected:
+    uint32_t game_, conn_;
+};
@@ -0,0 +1,248 @@
+#if defined(__linux__)
+ #include <sys/eventfd.h>
+ #include <unistd.h>
+#endif
+
+#include <cstring>
+#include <random>
+#include <thread>
+
+#include "checkers.h"
+
+struct engine_player_t : public player_t
+{
+protected:
+    // engine settings
+    engine_config_t config;
+    // engine search state
+    search_t search;
+    // endgame tablebase
+    tablebase_t tablebase;
+    // opening book
+    book_t book;
+    bool use_book;
+    // evaluation network
+    nnue_t net;
+    // picks between book moves so games vary
+    std::mt19937 random;
+    // our view of the current board
+    bitboard_t bits;
+    // set when it is our turn to move
+    bool thinking;
+    // background search for the current turn
+    std::thread worker;
+    // set by the worker once result and info are valid
+    std::atomic<bool> ready;
+    // worker output
+    bool found;
+    bool from_book;
+    bitmove_t result;
+    search_info_t info;
+    // signalled by the worker when a move is ready
+    int event_fd;
+
+    colour_e opponent() const
+    {
+        return colour==WHITE ? BLACK : WHITE;
+    }
+
+    // apply a move made by either side to our board
+    bool track_move(const move_t & move, colour_e turn)
+    {
+        move_list_t list;
+        if (!bits.generate(turn, list)) {
+            return false;
+        }
+        const bitmove_t * found = list.find(move);
+        if (!found) {
+            log(LOG_ERROR, "engine: unable to follow move");
+            return false;
+        }
+        bits.apply(*found, turn);
+        return true;
+    }
+
+    void think()
+    {
+        // answer from the opening book while we are still in it
+        from_book = use_book && book.probe(bits, colour, random(), result);
+        if (from_book) {
+            found = true;
+            memset(&info, 0, sizeof(info));
+        }
+        else {
+            found = search.think(bits, colour, config.limits, result, info);
+        }
+#if defined(__linux__)
+        // wake the game loop, before the result is published so the read
+        // in poll_move always finds the signal and never leaves one behind
+        const uint64_t one = 1;
+        if (write(event_fd, &one, sizeof(one)) != sizeof(one)) {
+            log(LOG_ERROR, "engine: unable to signal move");
+        }
+#endif
+        ready = true;
+    }
+
+    void join()
+    {
+        if (worker.joinable()) {
+            worker.join();
+        }
+    }
+
+public:
+    engine_player_t(colour_e colour, const engine_config_t & c)
+        : player_t(colour)
+        , config(c)
+        , use_book(false)
+        , random(std::random_device()())
+        , thinking(false)
+        , ready(false)
+        , found(false)
+        , from_book(false)
+        , event_fd(-1)
+    {
+        if (config.hash_mb > 0) {
+            search.set_hash_size(size_t(config.hash_mb));
+        }
+        if (config.threads > 0) {
+            search.set_threads(config.threads);
+        }
+        if (config.tb_path) {
+            if (tablebase.open(config.tb_path, config.tb_pieces)) {
+                search.set_tablebase(&tablebase);
+            }
+            else {
+                log(LOG_ERROR, "engine: unable to open tablebase '%s'", config.tb_path);
+            }
+        }
+        if (config.book_path) {
+            use_book = book.open(config.book_path);
+            if (!use_book) {
+                log(LOG_ERROR, "engine: unable to open book '%s'", config.book_path);
+            }
+        }
+        if (config.nnue_path) {
+            if (net.open(config.nnue_path)) {
+                search.set_network(&net);
+            }
+            else {
+                log(LOG_ERROR, "engine: unable to open network '%s'", config.nnue_path);
+            }
+        }
+#if defined(__linux__)
+        event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+#endif
+        board_t board;
+        board.reset();
+        bits = board.bits;
+    }
+
+    virtual ~engine_player_t()
+    {
+        search.stop();
+        join();
+#if defined(__linux__)
+        if (event_fd >= 0) {
+            close(event_fd);
+        }
+#endif
+    }
+
+    virtual bool is_connected()
+    {
+        return true;
+    }
+
+    virtual bool poll_move(move_t & out)
+    {
+        out.clear();
+        // nothing to do until our search has finished
+        if (!thinking || !ready) {
+            return true;
+        }
+        thinking = false;
+        join();
+#if defined(__linux__)
+        uint64_t value;
+        if (read(event_fd, &value, sizeof(value)) != sizeof(value)) {
+            log(LOG_WARN, "engine: missed move signal");
+        }
+#endif
+        if (!found) {
+            // we have no legal moves
+            return false;
+        }
+        if (!config.quiet && from_book) {
+            log("engine: book move");
+        }
+        else if (!config.quiet) {
+            log("engine: depth %d score %d nodes %llu time %dms",
+                info.depth,
+                info.score,
+                (unsigned long long)info.nodes,
+                info.time_ms);
+        }
+        // our move is applied to the board once accepted
+        bits.apply(result, colour);
+        return result.to_move(out);
+    }
+
+    virtual bool invalid_move(const move_t & move)
+    {
+        assert(!"engine produced an invalid move");
+        return false;
+    }
+
+    virtual bool send_move(const move_t & move)
+    {
+        return track_move(move, opponent());
+    }
+
+    virtual bool send_board(const board_t & board)
+    {
+        bits = board.bits;
+        return true;
+    }
+
+    virtual bool send_events(const event_list_t & events,
+                             const board_t & board)
+    {
+        // our board already follows the moves we are sent
+        return true;
+    }
+
+    virtual bool send_colour(colour_e c)
+    {
+        return true;
+    }
+
+    virtual bool request_move()
+    {
+        if (thinking) {
+            return true;
+        }
+        join();
+        // search the current board in the background
+        thinking = true;
+        ready = false;
+        worker = std::thread(&engine_player_t::think, this);
+        return true;
+    }
+
+    virtual bool bad_input()
+    {
+        return true;
+    }
+
+    virtual int wait_fd()
+    {
+        return event_fd;
+    }
+};
+
+player_t * new_engine_player(colour_e colour, const engine_config_t & config)
+{
+    return new engine_player_t(colour, config);
+}
@@ -0,0 +1,281 @@
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+ #define EVAL_X86 1
+ #include <immintrin.h>
+#endif
+
+#if defined(EVAL_X86) && !defined(_MSC_VER)
+ // let one function use instructions the rest of the build may not
+ #define TARGET(isa) __attribute__((target(isa)))
+#else
+ #define TARGET(isa)
+#endif
+
+#include "checkers.h"
+
+namespace {
+
+// piece values
+const int32_t MAN = 100;
+const int32_t KING = 130;
+// men left on the home row guard against the opponent crowning
+const int32_t BACK_RANK = 12;
+// men that are close to being crowned
+const int32_t ADVANCED = 6;
+// pieces holding the centre of the board
+const int32_t CENTRE = 4;
+// each simple move a side could make
+const int32_t MOBILITY = 2;
+// each row the men have advanced in total
+const int32_t TEMPO = 1;
+
+const uint32_t WHITE_ADVANCED = 0x0fff0000u;
+const uint32_t BLACK_ADVANCED = 0x0000fff0u;
+const uint32_t CENTRE_SQUARES = 0x00066000u;
+
+// squares whose row index has bit 0, 1 or 2 set, white men advance
+// towards row 7 and black men towards row 0
+const uint32_t ROW_BIT0 = 0xf0f0f0f0u;
+const uint32_t ROW_BIT1 = 0xff00ff00u;
+const uint32_t ROW_BIT2 = 0xffff0000u;
+
+typedef bitboard_t bb_t;
+
+int32_t evaluate_scalar(const bitboard_t & b, colour_e turn)
+{
+    const uint32_t wm = b.white & ~b.kings;
+    const uint32_t bm = b.black & ~b.kings;
+    const uint32_t wk = b.white & b.kings;
+    const uint32_t bk = b.black & b.kings;
+    const uint32_t empty = b.empty();
+    int32_t score = 0;
+    // material
+    score += (bb_t::count(wm) - bb_t::count(bm)) * MAN;
+    score += (bb_t::count(wk) - bb_t::count(bk)) * KING;
+    // back rank
+    score += (bb_t::count(wm & bb_t::BLACK_CROWN_ROW) -
+              bb_t::count(bm & bb_t::WHITE_CROWN_ROW)) * BACK_RANK;
+    // advancement
+    score += (bb_t::count(wm & WHITE_ADVANCED) -
+              bb_t::count(bm & BLACK_ADVANCED)) * ADVANCED;
+    // centre control
+    score += (bb_t::count(b.white & CENTRE_SQUARES) -
+              bb_t::count(b.black & CENTRE_SQUARES)) * CENTRE;
+    // mobility, counted one direction at a time
+    const int32_t white_moves =
+        bb_t::count(bb_t::step(b.white, bb_t::DOWN_LEFT) & empty) +
+        bb_t::count(bb_t::step(b.white, bb_t::DOWN_RIGHT) & empty) +
+        bb_t::count(bb_t::step(wk, bb_t::UP_LEFT) & empty) +
+        bb_t::count(bb_t::step(wk, bb_t::UP_RIGHT) & empty);
+    const int32_t black_moves =
+        bb_t::count(bb_t::step(b.black, bb_t::UP_LEFT) & empty) +
+        bb_t::count(bb_t::step(b.black, bb_t::UP_RIGHT) & empty) +
+        bb_t::count(bb_t::step(bk, bb_t::DOWN_LEFT) & empty) +
+        bb_t::count(bb_t::step(bk, bb_t::DOWN_RIGHT) & empty);
+    score += (white_moves - black_moves) * MOBILITY;
+    // tempo, the sum of the rows each side's men have advanced
+    const int32_t white_tempo = bb_t::count(wm & ROW_BIT0) +
+                                bb_t::count(wm & ROW_BIT1) * 2 +
+                                bb_t::count(wm & ROW_BIT2) * 4;
+    const int32_t black_tempo = bb_t::count(bm & ~ROW_BIT0) +
+                                bb_t::count(bm & ~ROW_BIT1) * 2 +
+                                bb_t::count(bm & ~ROW_BIT2) * 4;
+    score += (white_tempo - black_tempo) * TEMPO;
+    return (turn == WHITE) ? score : -score;
+}
+
+void batch_scalar(const bitboard_t * pos,
+                  const colour_e * turn,
+                  size_t count,
+                  int32_t * out)
+{
+    for (size_t i = 0; i < count; ++i) {
+        out[i] = evaluate_scalar(pos[i], turn[i]);
+    }
+}
+
+#if defined(EVAL_X86)
+
+// the same terms as evaluate_scalar for eight positions at once, one per
+// 32 bit lane
+
+TARGET("avx2")
+inline __m256i mask(__m256i v, uint32_t m)
+{
+    return _mm256_and_si256(v, _mm256_set1_epi32(int32_t(m)));
+}
+
+// bits set in each lane, from a nibble lookup table
+TARGET("avx2")
+inline __m256i popcount(__m256i v)
+{
+    const __m256i lut = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3,
+                                         1, 2, 2, 3, 2, 3, 3, 4,
+                                         0, 1, 1, 2, 1, 2, 2, 3,
+                                         1, 2, 2, 3, 2, 3, 3, 4);
+    const __m256i low = _mm256_set1_epi8(0x0f);
+    const __m256i lo = _mm256_and_si256(v, low);
+    const __m256i hi = _mm256_and_si256(_mm256_srli_epi16(v, 4), low);
+    const __m256i bytes = _mm256_add_epi8(_mm256_shuffle_epi8(lut, lo),
+                                          _mm256_shuffle_epi8(lut, hi));
+    // sum the four byte counts of each lane
+    const __m256i pairs = _mm256_maddubs_epi16(bytes, _mm256_set1_epi8(1));
+    return _mm256_madd_epi16(pairs, _mm256_set1_epi16(1));
+}
+
+TARGET("avx2")
+inline __m256i step_up_left(__m256i m)
+{
+    return _mm256_or_si256(_mm256_srli_epi32(mask(m, bb_t::EVEN_LEFT), 5),
+                           _mm256_srli_epi32(mask(m, bb_t::ODD_ROWS), 4));
+}
+
+TARGET("avx2")
+inline __m256i step_up_right(__m256i m)
+{
+    return _mm256_or_si256(_mm256_srli_epi32(mask(m, bb_t::EVEN_ROWS), 4),
+                           _mm256_srli_epi32(mask(m, bb_t::ODD_RIGHT), 3));
+}
+
+TARGET("avx2")
+inline __m256i step_down_left(__m256i m)
+{
+    return _mm256_or_si256(_mm256_slli_epi32(mask(m, bb_t::EVEN_LEFT), 3),
+                           _mm256_slli_epi32(mask(m, bb_t::ODD_ROWS), 4));
+}
+
+TARGET("avx2")
+inline __m256i step_down_right(__m256i m)
+{
+    return _mm256_or_si256(_mm256_slli_epi32(mask(m, bb_t::EVEN_ROWS), 4),
+                           _mm256_slli_epi32(mask(m, bb_t::ODD_RIGHT), 5));
+}
+
+// count(a) - count(b) scaled by a weight
+TARGET("avx2")
+inline __m256i term(__m256i a, __m256i b, int32_t weight)
+{
+    return _mm256_mullo_epi32(_mm256_sub_epi32(popcount(a), popcount(b)),
+                              _mm256_set1_epi32(weight));
+}
+
+TARGET("avx2")
+void batch_avx2(const bitboard_t * pos,
+                const colour_e * turn,
+                size_t count,
+                int32_t * out)
+{
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        // split the positions into one mask per lane
+        alignas(32) uint32_t white[8], black[8], kings[8];
+        alignas(32) int32_t sign[8];
+        for (size_t j = 0; j < 8; ++j) {
+            white[j] = pos[i + j].white;
+            black[j] = pos[i + j].black;
+            kings[j] = pos[i + j].kings;
+            sign[j] = (turn[i + j] == WHITE) ? 1 : -1;
+        }
+        const __m256i w = _mm256_load_si256((const __m256i *)white);
+        const __m256i b = _mm256_load_si256((const __m256i *)black);
+        const __m256i k = _mm256_load_si256((const __m256i *)kings);
+        const __m256i wm = _mm256_andnot_si256(k, w);
+        const __m256i bm = _mm256_andnot_si256(k, b);
+        const __m256i wk = _mm256_and_si256(w, k);
+        const __m256i bk = _mm256_and_si256(b, k);
+        const __m256i empty = _mm256_xor_si256(_mm256_or_si256(w, b),
+                                               _mm256_set1_epi32(-1));
+        // material
+        __m256i score = term(wm, bm, MAN);
+        score = _mm256_add_epi32(score, term(wk, bk, KING));
+        // back rank
+        score = _mm256_add_epi32(score, term(mask(wm, bb_t::BLACK_CROWN_ROW),
+                                             mask(bm, bb_t::WHITE_CROWN_ROW),
+                                             BACK_RANK));
+        // advancement
+        score = _mm256_add_epi32(score, term(mask(wm, WHITE_ADVANCED),
+                                             mask(bm, BLACK_ADVANCED),
+                                             ADVANCED));
+        // centre control
+        score = _mm256_add_epi32(score, term(mask(w, CENTRE_SQUARES),
+                                             mask(b, CENTRE_SQUARES),
+                                             CENTRE));
+        // mobility
+        __m256i moves = _mm256_add_epi32(
+            popcount(_mm256_and_si256(step_down_left(w), empty)),
+            popcount(_mm256_and_si256(step_down_right(w), empty)));
+        moves = _mm256_add_epi32(moves,
+            popcount(_mm256_and_si256(step_up_left(wk), empty)));
+        moves = _mm256_add_epi32(moves,
+            popcount(_mm256_and_si256(step_up_right(wk), empty)));
+        moves = _mm256_sub_epi32(moves,
+            popcount(_mm256_and_si256(step_up_left(b), empty)));
+        moves = _mm256_sub_epi32(moves,
+            popcount(_mm256_and_si256(step_up_right(b), empty)));
+        moves = _mm256_sub_epi32(moves,
+            popcount(_mm256_and_si256(step_down_left(bk), empty)));
+        moves = _mm256_sub_epi32(moves,
+            popcount(_mm256_and_si256(step_down_right(bk), empty)));
+        score = _mm256_add_epi32(score,
+            _mm256_mullo_epi32(moves, _mm256_set1_epi32(MOBILITY)));
+        // tempo
+        __m256i tempo = term(mask(wm, ROW_BIT0), mask(bm, ~ROW_BIT0), 1);
+        tempo = _mm256_add_epi32(tempo,
+            term(mask(wm, ROW_BIT1), mask(bm, ~ROW_BIT1), 2));
+        tempo = _mm256_add_epi32(tempo,
+            term(mask(wm, ROW_BIT2), mask(bm, ~ROW_BIT2), 4));
+        score = _mm256_add_epi32(score,
+            _mm256_mullo_epi32(tempo, _mm256_set1_epi32(TEMPO)));
+        // from the point of view of the side to move
+        score = _mm256_sign_epi32(score,
+            _mm256_load_si256((const __m256i *)sign));
+        _mm256_storeu_si256((__m256i *)(out + i), score);
+    }
+    for (; i < count; ++i) {
+        out[i] = evaluate_scalar(pos[i], turn[i]);
+    }
+}
+
+#endif // defined(EVAL_X86)
+
+} // namespace {}
+
+int32_t eval_t::evaluate(const bitboard_t & pos, colour_e turn)
+{
+    return evaluate_scalar(pos, turn);
+}
+
+eval_t::batch_fn_t eval_t::get(isa_e isa)
+{
+    switch (isa) {
+    case (SCALAR):
+        return batch_scalar;
+#if defined(EVAL_X86)
+    case (AVX2):
+        return cpu_t::avx2() ? batch_avx2 : nullptr;
+#endif
+    default:
+        return nullptr;
+    }
+}
+
+eval_t::batch_fn_t eval_t::best()
+{
+    for (int32_t isa = NUM_ISA - 1; isa > SCALAR; --isa) {
+        if (batch_fn_t fn = get(isa_e(isa))) {
+            return fn;
+        }
+    }
+    return batch_scalar;
+}
+
+const char * eval_t::name(isa_e isa)
+{
+    switch (isa) {
+    case (SCALAR):
+        return "scalar";
+    case (AVX2):
+        return "avx2";
+    default:
+        return "unknown";
+    }
+}
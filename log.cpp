@@ -1,12 +1,396 @@
-#include <stdarg.h>
-#include <stdio.h>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
 
+#include "checkers.h"
+
+namespace {
+
+// longest message kept, anything longer is cut short
+const size_t TEXT_SIZE = 232;
+// messages one thread may have waiting before new ones are dropped
+const size_t RING_SIZE = 256;
+// the log thread sleeps until it is woken for new messages, this is only
+// a backstop
+const int32_t IDLE_MS = 1000;
+
+struct record_t
+{
+    // microseconds since the unix epoch
+    uint64_t time_us;
+    uint32_t game;
+    uint32_t conn;
+    log_level_e level;
+    char text[TEXT_SIZE];
+};
+
+// messages from one thread waiting to be written
+struct stream_t
+{
+    stream_t()
+        : dropped(0)
+        , retired(false)
+    {
+    }
+
+    spsc_ring_t<record_t, RING_SIZE> ring;
+    // messages lost because the ring was full
+    std::atomic<uint64_t> dropped;
+    // set once the owning thread has exited
+    std::atomic<bool> retired;
+};
+
+// per thread logging state
+struct local_t
+{
+    local_t()
+        : game(0)
+        , conn(0)
+    {
+    }
+
+    ~local_t()
+    {
+        if (stream) {
+            stream->retired = true;
+        }
+    }
+
+    std::shared_ptr<stream_t> stream;
+    uint32_t game;
+    uint32_t conn;
+};
+
+thread_local local_t local;
+
+const char * level_name(log_level_e level)
+{
+    switch (level) {
+    case (LOG_DEBUG):
+        return "debug";
+    case (LOG_INFO):
+        return "info ";
+    case (LOG_WARN):
+        return "warn ";
+    case (LOG_ERROR):
+        return "error";
+    default:
+        return "?    ";
+    }
+}
+
+uint64_t now_us()
+{
+    using namespace std::chrono;
+    return uint64_t(duration_cast<microseconds>(
+        system_clock::now().time_since_epoch()).count());
+}
+
+// collects messages from every thread and writes them out in batches
+struct logger_t
+{
+    logger_t()
+        : level(LOG_INFO)
+        , stopping(false)
+        , flush_asked(0)
+        , flush_done(0)
+        , idle(false)
+        , second(~0ull)
+    {
+        stamp[0] = '\0';
+    }
+
+    std::atomic<int32_t> level;
+
+    // guards streams and stopping, producers only take it once when
+    // their thread first logs
+    std::mutex mux;
+    std::condition_variable wake;
+    std::vector<std::shared_ptr<stream_t>> streams;
+    bool stopping;
+    std::thread writer;
+    // flush requests made and the last one written out, also under mux
+    uint64_t flush_asked;
+    uint64_t flush_done;
+    std::condition_variable flushed;
+    // set while the log thread is asleep with nothing to write, so only
+    // the first message after that has to wake it
+    std::atomic<bool> idle;
+
+    // owned by the log thread
+    std::vector<record_t> batch;
+    std::vector<std::shared_ptr<stream_t>> live;
+    // the formatted date and time of the last second written
+    uint64_t second;
+    char stamp[32];
+
+    void add(const std::shared_ptr<stream_t> & stream)
+    {
+        std::lock_guard<std::mutex> guard(mux);
+        streams.push_back(stream);
+    }
+
+    void stop()
+    {
+        {
+            std::lock_guard<std::mutex> guard(mux);
+            stopping = true;
+        }
+        wake.notify_one();
+        if (writer.joinable()) {
+            writer.join();
+        }
+    }
+
+    // wake the log thread for a message just queued if it is asleep
+    void nudge()
+    {
+        // pairs with the fence in run, so either we see it idle or it sees
+        // our message before it sleeps
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (idle.load(std::memory_order_relaxed) && idle.exchange(false)) {
+            std::lock_guard<std::mutex> guard(mux);
+            wake.notify_one();
+        }
+    }
+
+    // true if any thread has messages waiting (holding mux)
+    bool queued() const
+    {
+        for (const auto & s : streams) {
+            if (!s->ring.empty()) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // wait until everything queued before the call has been written
+    void flush()
+    {
+        std::unique_lock<std::mutex> lock(mux);
+        if (stopping) {
+            return;
+        }
+        const uint64_t ticket = ++flush_asked;
+        wake.notify_one();
+        flushed.wait(lock, [this, ticket]() { return flush_done >= ticket; });
+    }
+
+    void run()
+    {
+        for (bool last = false; !last;) {
+            uint64_t answering;
+            {
+                std::unique_lock<std::mutex> lock(mux);
+                idle.store(true);
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                wake.wait_for(lock,
+                              std::chrono::milliseconds(IDLE_MS),
+                              [this]() {
+                                  return stopping || !idle.load() ||
+                                         flush_asked != flush_done ||
+                                         queued();
+                              });
+                idle.store(false);
+                last = stopping;
+                live = streams;
+                answering = flush_asked;
+            }
+            collect();
+            write();
+            {
+                std::lock_guard<std::mutex> guard(mux);
+                flush_done = answering;
+            }
+            flushed.notify_all();
+        }
+    }
+
+    // move every waiting message into the batch
+    void collect()
+    {
+        batch.clear();
+        std::vector<stream_t *> gone;
+        for (const auto & s : live) {
+            // an exited thread can push nothing more once we see this
+            const bool retired = s->retired.load();
+            record_t r;
+            while (s->ring.pop(r)) {
+                batch.push_back(r);
+            }
+            if (const uint64_t dropped = s->dropped.exchange(0)) {
+                record_t & w = push_note(LOG_WARN);
+                snprintf(w.text, sizeof(w.text),
+                         "log: dropped %llu messages",
+                         (unsigned long long)dropped);
+            }
+            if (retired) {
+                gone.push_back(s.get());
+            }
+        }
+        live.clear();
+        if (!gone.empty()) {
+            std::lock_guard<std::mutex> guard(mux);
+            streams.erase(
+                std::remove_if(streams.begin(), streams.end(),
+                    [&gone](const std::shared_ptr<stream_t> & s) {
+                        return std::find(gone.begin(), gone.end(), s.get()) != gone.end();
+                    }),
+                streams.end());
+        }
+        // interleave the threads in the order things happened
+        std::stable_sort(batch.begin(), batch.end(),
+            [](const record_t & a, const record_t & b) {
+                return a.time_us < b.time_us;
+            });
+    }
+
+    record_t & push_note(log_level_e level)
+    {
+        batch.push_back(record_t());
+        record_t & r = batch.back();
+        r.time_us = now_us();
+        r.game = 0;
+        r.conn = 0;
+        r.level = level;
+        return r;
+    }
+
+    void format_stamp(uint64_t time_us)
+    {
+        const uint64_t s = time_us / 1000000;
+        if (s == second) {
+            return;
+        }
+        second = s;
+        const time_t t = time_t(s);
+        tm parts;
+#if defined(_MSC_VER)
+        gmtime_s(&parts, &t);
+#else
+        gmtime_r(&t, &parts);
+#endif
+        strftime(stamp, sizeof(stamp), "%Y-%m-%dT%H:%M:%S", &parts);
+    }
+
+    void write()
+    {
+        if (batch.empty()) {
+            return;
+        }
+        for (const record_t & r : batch) {
+            format_stamp(r.time_us);
+            const unsigned ms = unsigned((r.time_us / 1000) % 1000);
+            if (r.game && r.conn) {
+                fprintf(stdout, "%s.%03uZ %s game=%u conn=%u %s\n",
+                        stamp, ms, level_name(r.level), r.game, r.conn, r.text);
+            }
+            else if (r.game) {
+                fprintf(stdout, "%s.%03uZ %s game=%u %s\n",
+                        stamp, ms, level_name(r.level), r.game, r.text);
+            }
+            else if (r.conn) {
+                fprintf(stdout, "%s.%03uZ %s conn=%u %s\n",
+                        stamp, ms, level_name(r.level), r.conn, r.text);
+            }
+            else {
+                fprintf(stdout, "%s.%03uZ %s %s\n",
+                        stamp, ms, level_name(r.level), r.text);
+            }
+        }
+        fflush(stdout);
+    }
+};
+
+logger_t & logger();
+
+// write out whatever is still queued when the program exits
+void stop_logger()
+{
+    logger().stop();
+}
+
+logger_t & logger()
+{
+    // never freed, threads still running at exit may yet log
+    static logger_t * instance = []() {
+        logger_t * l = new logger_t;
+        l->writer = std::thread(&logger_t::run, l);
+        atexit(stop_logger);
+        return l;
+    }();
+    return *instance;
+}
+
+void vlog(log_level_e level, const char * fmt, va_list vargs)
+{
+    logger_t & l = logger();
+    if (int32_t(level) < l.level.load(std::memory_order_relaxed)) {
+        return;
+    }
+    if (!local.stream) {
+        local.stream = std::make_shared<stream_t>();
+        l.add(local.stream);
+    }
+    record_t r;
+    r.time_us = now_us();
+    r.game = local.game;
+    r.conn = local.conn;
+    r.level = level;
+    vsnprintf(r.text, sizeof(r.text), fmt, vargs);
+    if (!local.stream->ring.push(r)) {
+        local.stream->dropped.fetch_add(1, std::memory_order_relaxed);
+    }
+    l.nudge();
+}
+
+} // namespace {}
 
 void log(const char * fmt, ...)
 {
     va_list vargs;
     va_start(vargs, fmt);
-    vfprintf(stdout, fmt, vargs);
+    vlog(LOG_INFO, fmt, vargs);
     va_end(vargs);
-    fputc('\n', stdout);
+}
+
+void log(log_level_e level, const char * fmt, ...)
+{
+    va_list vargs;
+    va_start(vargs, fmt);
+    vlog(level, fmt, vargs);
+    va_end(vargs);
+}
+
+void log_flush()
+{
+    logger().flush();
+}
+
+void log_set_level(log_level_e level)
+{
+    logger().level = int32_t(level);
+}
+
+log_scope_t::log_scope_t(uint32_t game, uint32_t conn)
+    : game_(local.game)
+    , conn_(local.conn)
+{
+    local.game = game;
+    local.conn = conn;
+}
+
+log_scope_t::~log_scope_t()
+{
+    local.game = game_;
+    local.conn = conn_;
 }
@@ -1,71 +1,217 @@
 #include <thread>
-#include <SDL/SDL.h>
+#include <cstdlib>
+#include <cstring>
+#if defined(CHECKERS_SDL)
+ #include <SDL/SDL.h>
+#endif
 #include "checkers.h"
 
 void game_thread(checkers_t * game)
 {
     while (game->is_active()) {
+        const int32_t before = game->plies();
         // check for and handle moves from the current player
         game->poll_players();
-        // give time back to the CPU
-        SDL_Delay(1);
+        // sleep until the current player has something for us
+        if (game->plies() == before) {
+            game->wait_players();
+        }
     }
 }
 
 int main(int argc, char * args[])
 {
+    // play white with the built in engine instead of a remote player
+    bool engine = false;
+    // host many headless games instead of one rendered game
+    bool server = false;
+    const char * address = "127.0.0.1";
+    uint16_t port = 1234;
+    // PDN file finished games are appended to (may be nullptr)
+    const char * pdn_path = nullptr;
+    // play without a window, builds without SDL are always headless
+#if defined(CHECKERS_SDL)
+    bool headless = false;
+#else
+    bool headless = true;
+#endif
+    // file the board events are written to instead of drawn (may be nullptr)
+    const char * events_path = nullptr;
+#if defined(CHECKERS_SDL)
+    // server games to show tiled in one window
+    int32_t spectate = 0;
+#endif
+    engine_config_t config = {{0, 300}, 16, 1, nullptr, 8, nullptr, false, nullptr};
+    // file kept up to date with the server metrics (may be nullptr)
+    const char * metrics_path = nullptr;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(args[i], "-engine") == 0) {
+            engine = true;
+        }
+        else if (strcmp(args[i], "-depth") == 0 && i+1 < argc) {
+            config.limits.depth = atoi(args[++i]);
+        }
+        else if (strcmp(args[i], "-time") == 0 && i+1 < argc) {
+            config.limits.time_ms = atoi(args[++i]);
+        }
+        else if (strcmp(args[i], "-hash") == 0 && i+1 < argc) {
+            config.hash_mb = atoi(args[++i]);
+        }
+        else if (strcmp(args[i], "-threads") == 0 && i+1 < argc) {
+            config.threads = atoi(args[++i]);
+        }
+        else if (strcmp(args[i], "-tb") == 0 && i+1 < argc) {
+            config.tb_path = args[++i];
+        }
+        else if (strcmp(args[i], "-book") == 0 && i+1 < argc) {
+            config.book_path = args[++i];
+        }
+        else if (strcmp(args[i], "-nnue") == 0 && i+1 < argc) {
+            config.nnue_path = args[++i];
+        }
+        else if (strcmp(args[i], "-server") == 0) {
+            server = true;
+        }
+        else if (strcmp(args[i], "-addr") == 0 && i+1 < argc) {
+            address = args[++i];
+        }
+        else if (strcmp(args[i], "-port") == 0 && i+1 < argc) {
+            port = uint16_t(atoi(args[++i]));
+        }
+        else if (strcmp(args[i], "-pdn") == 0 && i+1 < argc) {
+            pdn_path = args[++i];
+        }
+        else if (strcmp(args[i], "-headless") == 0) {
+            headless = true;
+        }
+        else if (strcmp(args[i], "-spectate") == 0 && i+1 < argc) {
+#if defined(CHECKERS_SDL)
+            spectate = atoi(args[++i]);
+#else
+            ++i;
+            log(LOG_WARN, "-spectate needs a build with SDL, ignoring it");
+#endif
+        }
+        else if (strcmp(args[i], "-metrics") == 0 && i+1 < argc) {
+            metrics_path = args[++i];
+        }
+        else if (strcmp(args[i], "-verbose") == 0) {
+            log_set_level(LOG_DEBUG);
+        }
+        else if (strcmp(args[i], "-quiet") == 0) {
+            log_set_level(LOG_WARN);
+        }
+        else if (strcmp(args[i], "-events") == 0 && i+1 < argc) {
+            events_path = args[++i];
+            headless = true;
+        }
+    }
+
+    // once a second, in the prometheus text format
+    if (metrics_path && !metrics_t::start_dump(metrics_path, 1000)) {
+        return 1;
+    }
+
+    if (server) {
+        tcp_server_t server_;
+        if (!server_.start(address, port)) {
+            return 1;
+        }
+        if (pdn_path && !server_.record(pdn_path)) {
+            return 1;
+        }
+#if defined(CHECKERS_SDL)
+        if (spectate > 0 && !headless) {
+            render_pool_t * pool = new_sdl_spectator(spectate);
+            if (!pool->init() || !server_.spectate(pool)) {
+                return 1;
+            }
+            // the window belongs to this thread so serve from another
+            std::thread serving([&server_]() { server_.run(); });
+            while (pool->tick()) {
+                // give time back to the CPU
+                SDL_Delay(1);
+            }
+            server_.stop();
+            serving.join();
+            delete pool;
+            return 0;
+        }
+#endif
+        return server_.run() ? 0 : 1;
+    }
+
     tcp_factory_t fact_;
-    if (!fact_.start()) {
+    if (!fact_.start(address, port)) {
         return 1;
     }
 
     // create two players
     std::array<player_t *, 2> players = {
         fact_.new_tcp_player(BLACK),
-        fact_.new_tcp_player(WHITE)
+        engine ? new_engine_player(WHITE, config) :
+                 fact_.new_tcp_player(WHITE)
     };
 
-    // wait for both players to connect
-    for (;;) {
-        // if both players have connected
-        if (players[0]->is_connected() &&
-            players[1]->is_connected()) {
-            // let the match begin
-            break;
-        }
-        // not all players connected
-        else {
-            // give time back to the CPU
-            SDL_Delay(1);
-        }
+    // players are connected once accepted
+    if (!players[0] || !players[1]) {
+        return 1;
     }
     // create the board renderer
-    render_t * render = new_sdl_render();
-    if (render && !render->init()) {
+    render_t * render = nullptr;
+    if (events_path) {
+        render = new_record_render(events_path);
+    }
+    else if (headless) {
+        render = new_null_render();
+    }
+#if defined(CHECKERS_SDL)
+    else {
+        render = new_sdl_render();
+    }
+#endif
+    if (!render || !render->init()) {
         return 1;
     }
-    // create a new board with the selected players
-    checkers_t game = checkers_t(players, render);
-    // spark a new thread to simulate the game in
-    std::thread * thread = new std::thread(game_thread, &game);
-    if (!thread) {
+    pdn_writer_t recorder;
+    if (pdn_path && !recorder.open(pdn_path)) {
+        log(LOG_ERROR, "unable to open '%s' to record games", pdn_path);
         return 1;
     }
-    // while there is an active game being played
-    while (game.is_active()) {
-        // draw the board to the screen
-        if (!render->tick()) {
-            game.end();
-        }
-        // give time back to the CPU
-        SDL_Delay(1);
+    // create a new board with the selected players
+    checkers_t game(players, render, pdn_path ? &recorder : nullptr);
+    if (headless) {
+        // nothing to draw so simulate the game on this thread
+        game_thread(&game);
     }
-    // wait for the game thread to die
+#if defined(CHECKERS_SDL)
+    else {
+        // spark a new thread to simulate the game in
+        std::thread * thread = new std::thread(game_thread, &game);
+        if (!thread) {
+            return 1;
+        }
+        // while there is an active game being played
+        while (game.is_active()) {
+            // draw the board to the screen
+            if (!render->tick()) {
+                game.end();
+            }
+            // give time back to the CPU
+            SDL_Delay(1);
+        }
+        // wait for the game thread to die
 #if 0
-    thread->join();
+        thread->join();
+#endif
+    }
 #endif
 
     // end
     fact_.stop();
+    // a rendered game thread is never joined and may still be using it
+    if (headless) {
+        delete render;
+    }
     return 0;
 }
@@ -0,0 +1,321 @@
+#include <algorithm>
+#include <condition_variable>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "checkers.h"
+
+namespace {
+
+// histogram buckets have upper bounds of 1us, 2us, 4us ... ~8.4s
+const size_t NUM_BUCKETS = 24;
+
+const char * counter_name(metrics_t::counter_e counter)
+{
+    switch (counter) {
+    case (metrics_t::TCP_SENT_BYTES):
+        return "checkers_tcp_sent_bytes_total";
+    case (metrics_t::TCP_RECV_BYTES):
+        return "checkers_tcp_received_bytes_total";
+    default:
+        return "checkers_unknown_total";
+    }
+}
+
+const char * timer_name(metrics_t::timer_e timer)
+{
+    switch (timer) {
+    case (metrics_t::POLL_PLAYERS):
+        return "checkers_poll_players_seconds";
+    case (metrics_t::APPLY_MOVE):
+        return "checkers_apply_move_seconds";
+    case (metrics_t::BOARD_MOVE):
+        return "checkers_board_move_seconds";
+    case (metrics_t::BOARD_SERIALIZE):
+        return "checkers_board_serialize_seconds";
+    default:
+        return "checkers_unknown_seconds";
+    }
+}
+
+struct histogram_t
+{
+    // the last bucket counts everything slower than the largest bound
+    uint64_t buckets[NUM_BUCKETS + 1];
+    uint64_t sum_ns;
+    uint64_t count;
+};
+
+struct totals_t
+{
+    uint64_t counters[metrics_t::NUM_COUNTERS];
+    histogram_t timers[metrics_t::NUM_TIMERS];
+};
+
+// metrics from one thread, only ever written by that thread so updates
+// need no locked instructions, only atomics so readers see whole values
+struct shard_t
+{
+    std::atomic<uint64_t> counters[metrics_t::NUM_COUNTERS];
+    struct {
+        std::atomic<uint64_t> buckets[NUM_BUCKETS + 1];
+        std::atomic<uint64_t> sum_ns;
+        std::atomic<uint64_t> count;
+    } timers[metrics_t::NUM_TIMERS];
+
+    shard_t()
+    {
+        for (auto & c : counters) {
+            c = 0;
+        }
+        for (auto & t : timers) {
+            for (auto & b : t.buckets) {
+                b = 0;
+            }
+            t.sum_ns = 0;
+            t.count = 0;
+        }
+    }
+
+    // add to a value only this thread writes
+    static void bump(std::atomic<uint64_t> & v, uint64_t n)
+    {
+        v.store(v.load(std::memory_order_relaxed) + n,
+                std::memory_order_relaxed);
+    }
+
+    void merge_into(totals_t & out) const
+    {
+        for (size_t i = 0; i < metrics_t::NUM_COUNTERS; ++i) {
+            out.counters[i] += counters[i].load(std::memory_order_relaxed);
+        }
+        for (size_t i = 0; i < metrics_t::NUM_TIMERS; ++i) {
+            histogram_t & h = out.timers[i];
+            for (size_t b = 0; b <= NUM_BUCKETS; ++b) {
+                h.buckets[b] += timers[i].buckets[b].load(std::memory_order_relaxed);
+            }
+            h.sum_ns += timers[i].sum_ns.load(std::memory_order_relaxed);
+            h.count += timers[i].count.load(std::memory_order_relaxed);
+        }
+    }
+};
+
+struct registry_t
+{
+    std::mutex mux;
+    std::vector<shard_t *> shards;
+    // folded in from the shards of threads that have exited
+    totals_t retired;
+
+    // dump thread state
+    std::thread dumper;
+    std::condition_variable wake;
+    bool dumping;
+
+    registry_t()
+        : retired()
+        , dumping(false)
+    {
+    }
+};
+
+registry_t & registry()
+{
+    // never freed, threads may still record during exit
+    static registry_t * instance = new registry_t;
+    return *instance;
+}
+
+// owns this threads shard and hands its counts over when the thread ends
+struct local_t
+{
+    shard_t * shard;
+
+    local_t()
+        : shard(nullptr)
+    {
+    }
+
+    ~local_t()
+    {
+        if (!shard) {
+            return;
+        }
+        registry_t & r = registry();
+        std::lock_guard<std::mutex> guard(r.mux);
+        shard->merge_into(r.retired);
+        for (size_t i = 0; i < r.shards.size(); ++i) {
+            if (r.shards[i] == shard) {
+                r.shards[i] = r.shards.back();
+                r.shards.pop_back();
+                break;
+            }
+        }
+        delete shard;
+    }
+
+    shard_t & get()
+    {
+        if (!shard) {
+            shard = new shard_t;
+            registry_t & r = registry();
+            std::lock_guard<std::mutex> guard(r.mux);
+            r.shards.push_back(shard);
+        }
+        return *shard;
+    }
+};
+
+thread_local local_t local;
+
+void append(std::string & out, const char * fmt, ...)
+#if !defined(_MSC_VER)
+    __attribute__((format(printf, 2, 3)))
+#endif
+    ;
+
+void append(std::string & out, const char * fmt, ...)
+{
+    char line[256];
+    va_list vargs;
+    va_start(vargs, fmt);
+    const int size = vsnprintf(line, sizeof(line), fmt, vargs);
+    va_end(vargs);
+    if (size > 0) {
+        out.append(line, std::min(size_t(size), sizeof(line) - 1));
+    }
+}
+
+// write to a temporary file then rename it over the target so a reader
+// never sees half a file
+bool write_file(const char * path, const std::string & text)
+{
+    const std::string temp = std::string(path) + ".tmp";
+    FILE * fd = fopen(temp.c_str(), "wb");
+    if (!fd) {
+        return false;
+    }
+    const bool ok = fwrite(text.data(), 1, text.size(), fd) == text.size();
+    if (fclose(fd) != 0 || !ok) {
+        remove(temp.c_str());
+        return false;
+    }
+#if defined(_MSC_VER)
+    // windows will not rename over an existing file
+    remove(path);
+#endif
+    return rename(temp.c_str(), path) == 0;
+}
+
+} // namespace {}
+
+void metrics_t::add(counter_e counter, uint64_t value)
+{
+    shard_t::bump(local.get().counters[counter], value);
+}
+
+void metrics_t::record(timer_e timer, uint64_t ns)
+{
+    size_t bucket = 0;
+    while (bucket < NUM_BUCKETS && ns > (1000ull << bucket)) {
+        ++bucket;
+    }
+    auto & t = local.get().timers[timer];
+    shard_t::bump(t.buckets[bucket], 1);
+    shard_t::bump(t.sum_ns, ns);
+    shard_t::bump(t.count, 1);
+}
+
+void metrics_t::format(std::string & out)
+{
+    totals_t totals = totals_t();
+    {
+        registry_t & r = registry();
+        std::lock_guard<std::mutex> guard(r.mux);
+        totals = r.retired;
+        for (const shard_t * s : r.shards) {
+            s->merge_into(totals);
+        }
+    }
+    out.clear();
+    for (size_t i = 0; i < NUM_COUNTERS; ++i) {
+        const char * name = counter_name(counter_e(i));
+        append(out, "# TYPE %s counter\n", name);
+        append(out, "%s %llu\n", name, (unsigned long long)totals.counters[i]);
+    }
+    for (size_t i = 0; i < NUM_TIMERS; ++i) {
+        const char * name = timer_name(timer_e(i));
+        const histogram_t & h = totals.timers[i];
+        append(out, "# TYPE %s histogram\n", name);
+        // prometheus buckets count everything at or below their bound
+        uint64_t below = 0;
+        for (size_t b = 0; b < NUM_BUCKETS; ++b) {
+            below += h.buckets[b];
+            append(out, "%s_bucket{le=\"%g\"} %llu\n",
+                   name, double(1000ull << b) * 1e-9, (unsigned long long)below);
+        }
+        append(out, "%s_bucket{le=\"+Inf\"} %llu\n", name, (unsigned long long)h.count);
+        append(out, "%s_sum %.9f\n", name, double(h.sum_ns) * 1e-9);
+        append(out, "%s_count %llu\n", name, (unsigned long long)h.count);
+    }
+}
+
+bool metrics_t::start_dump(const char * path, int32_t period_ms)
+{
+    registry_t & r = registry();
+    std::lock_guard<std::mutex> guard(r.mux);
+    if (r.dumping) {
+        return false;
+    }
+    std::string first;
+    if (!write_file(path, first)) {
+        log(LOG_ERROR, "unable to write metrics to '%s'", path);
+        return false;
+    }
+    r.dumping = true;
+    // write the final numbers out on the way out
+    static bool registered = false;
+    if (!registered) {
+        registered = true;
+        atexit(metrics_t::stop_dump);
+    }
+    const std::string target(path);
+    r.dumper = std::thread([&r, target, period_ms]() {
+        std::string text;
+        std::unique_lock<std::mutex> lock(r.mux);
+        for (;;) {
+            const bool last = !r.dumping;
+            lock.unlock();
+            format(text);
+            if (!write_file(target.c_str(), text)) {
+                log(LOG_WARN, "unable to write metrics to '%s'", target.c_str());
+            }
+            lock.lock();
+            if (last) {
+                return;
+            }
+            r.wake.wait_for(lock, std::chrono::milliseconds(period_ms));
+        }
+    });
+    return true;
+}
+
+void metrics_t::stop_dump()
+{
+    registry_t & r = registry();
+    {
+        std::lock_guard<std::mutex> guard(r.mux);
+        if (!r.dumping) {
+            return;
+        }
+        r.dumping = false;
+    }
+    r.wake.notify_one();
+    // the dump thread writes one final copy before it exits
+    r.dumper.join();
+}
@@ -0,0 +1,190 @@
+#include "checkers.h"
+
+namespace {
+
+// state shared while expanding a capture sequence
+struct jump_state_t
+{
+    colour_e turn;
+    // opponent pieces that can be captured
+    uint32_t opponent;
+    // squares that can be landed on
+    uint32_t empty;
+    // is the moving piece crowned
+    bool crowned;
+    // move being built
+    bitmove_t move;
+    // destination move list
+    move_list_t * out;
+    // set if the move list filled up
+    bool overflow;
+};
+
+bool emit(jump_state_t & s)
+{
+    if (s.out->size >= move_list_t::MAX_MOVES) {
+        s.overflow = true;
+        return false;
+    }
+    s.out->move[s.out->size++] = s.move;
+    return true;
+}
+
+// depth first search of all capture sequences continuing from a square
+bool expand_jumps(jump_state_t & s, const uint32_t at)
+{
+    bool extended = false;
+    for (int32_t d = 0; d < 4; ++d) {
+        const bitboard_t::dir_e dir = bitboard_t::dir_e(d);
+        // uncrowned pieces can only travel forward
+        if (!s.crowned && !bitboard_t::is_forward(s.turn, dir)) {
+            continue;
+        }
+        // a piece can only be jumped once per move
+        const uint32_t mid = bitboard_t::step(at, dir) &
+                             s.opponent & ~s.move.taken;
+        const uint32_t land = bitboard_t::step(mid, dir) & s.empty;
+        if (!land) {
+            continue;
+        }
+        extended = true;
+        // push this hop
+        s.move.path[s.move.hops++] = uint8_t(bitboard_t::lsb(land));
+        s.move.taken |= mid;
+        // uncrowned pieces end their move when reaching the far row
+        if (!s.crowned && (land & bitboard_t::crown_row(s.turn))) {
+            emit(s);
+        }
+        // emit if the sequence can go no further
+        else if (!expand_jumps(s, land)) {
+            emit(s);
+        }
+        // pop this hop
+        s.move.taken &= ~mid;
+        --s.move.hops;
+    }
+    return extended;
+}
+
+} // namespace {}
+
+uint32_t bitboard_t::jumpers(colour_e turn) const
+{
+    const uint32_t own = pieces(turn);
+    const uint32_t opponent = pieces(turn==WHITE ? BLACK : WHITE);
+    const uint32_t free = empty();
+    uint32_t out = 0;
+    for (int32_t d = 0; d < 4; ++d) {
+        const dir_e dir = dir_e(d);
+        const dir_e rev = reverse(dir);
+        // uncrowned pieces can only travel forward
+        const uint32_t movers = is_forward(turn, dir) ? own : (own & kings);
+        // empty squares that can be landed on from this direction
+        const uint32_t land = step(step(movers, dir) & opponent, dir) & free;
+        // trace back to the pieces that would make the jump
+        out |= step(step(land, rev) & opponent, rev) & movers;
+    }
+    return out;
+}
+
+bool bitboard_t::generate(colour_e turn, move_list_t & out) const
+{
+    out.size = 0;
+    const uint32_t own = pieces(turn);
+    // captures are mandatory when available
+    const uint32_t capture = jumpers(turn);
+    if (capture) {
+        jump_state_t s;
+        s.turn = turn;
+        s.opponent = pieces(turn==WHITE ? BLACK : WHITE);
+        s.out = &out;
+        s.overflow = false;
+        for (uint32_t m = capture; m; m &= m-1) {
+            const uint32_t bit = m & (0u-m);
+            // the moving piece vacates its starting square
+            s.empty = empty() | bit;
+            s.crowned = (kings & bit) != 0;
+            s.move.from = uint8_t(lsb(bit));
+            s.move.hops = 0;
+            s.move.taken = 0;
+            expand_jumps(s, bit);
+        }
+        return !s.overflow;
+    }
+    // otherwise every single step is legal
+    const uint32_t free = empty();
+    for (int32_t d = 0; d < 4; ++d) {
+        const dir_e dir = dir_e(d);
+        // uncrowned pieces can only travel forward
+        const uint32_t movers = is_forward(turn, dir) ? own : (own & kings);
+        for (uint32_t m = step(movers, dir) & free; m; m &= m-1) {
+            if (out.size >= move_list_t::MAX_MOVES) {
+                return false;
+            }
+            bitmove_t & move = out.move[out.size++];
+            const int32_t to = lsb(m);
+            move.from = uint8_t(lsb(step(1u << to, reverse(dir))));
+            move.hops = 1;
+            move.path[0] = uint8_t(to);
+            move.taken = 0;
+        }
+    }
+    return true;
+}
+
+void bitboard_t::apply(const bitmove_t & move, colour_e turn)
+{
+    const uint32_t from = 1u << move.from;
+    const uint32_t to = 1u << move.to();
+    uint32_t & own = (turn==WHITE) ? white : black;
+    uint32_t & opponent = (turn==WHITE) ? black : white;
+    // move the piece (a king may finish where it started)
+    own = (own & ~from) | to;
+    // remove captured pieces
+    opponent &= ~move.taken;
+    kings &= ~move.taken;
+    // crowned pieces stay crowned, others crown on the far row
+    if (kings & from) {
+        kings = (kings & ~from) | to;
+    }
+    else if (to & crown_row(turn)) {
+        kings |= to;
+    }
+}
+
+bool bitmove_t::to_move(move_t & out) const
+{
+    out.clear();
+    out.push_back(bitboard_t::position(from));
+    for (size_t i = 0; i < hops; ++i) {
+        out.push_back(bitboard_t::position(path[i]));
+    }
+    return hops > 0;
+}
+
+bool bitmove_t::matches(const move_t & move) const
+{
+    // the move must list the start and every square landed on
+    if (move.size() != size_t(hops) + 1) {
+        return false;
+    }
+    if (bitboard_t::square(move[0]) != int32_t(from)) {
+        return false;
+    }
+    for (size_t i = 0; i < hops; ++i) {
+        if (bitboard_t::square(move[i+1]) != int32_t(path[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+const bitmove_t * move_list_t::find(const move_t & m) const
+{
+    for (size_t i = 0; i < size; ++i) {
+        if (move[i].matches(m)) {
+            return &move[i];
+        }
+    }
+    return nullptr;
+}
@@ -0,0 +1,473 @@
+#if !defined(_MSC_VER)
+ #include <fcntl.h>
+ #include <sys/mman.h>
+ #include <sys/stat.h>
+ #include <unistd.h>
+#endif
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+ #define NNUE_X86 1
+ #include <immintrin.h>
+#endif
+
+#if defined(NNUE_X86) && !defined(_MSC_VER)
+ // let one function use instructions the rest of the build may not
+ #define TARGET(isa) __attribute__((target(isa)))
+#else
+ #define TARGET(isa)
+#endif
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#include "checkers.h"
+
+namespace {
+
+const char NNUE_MAGIC[4] = {'C', 'K', 'N', 'N'};
+const uint32_t NNUE_VERSION = 1;
+// the weights start this far into the file so they are well aligned
+const size_t WEIGHTS_OFFSET = 64;
+
+// network file header, followed by nnue_t::weights_t at WEIGHTS_OFFSET
+struct nnue_header_t
+{
+    char magic[4];
+    uint32_t version;
+    uint32_t features;
+    uint32_t hidden;
+    uint32_t l2;
+};
+
+typedef nnue_t::weights_t weights_t;
+typedef nnue_t::accumulator_t accumulator_t;
+
+const size_t HIDDEN = nnue_t::HIDDEN;
+const size_t L2 = nnue_t::L2;
+const int32_t QA = nnue_t::QA;
+const int32_t QB = nnue_t::QB;
+
+static_assert(sizeof(weights_t) ==
+              sizeof(int16_t) * (nnue_t::FEATURES + 1) * HIDDEN +
+              sizeof(int8_t) * L2 * 2 * HIDDEN + sizeof(int32_t) * L2 +
+              sizeof(int8_t) * L2 + sizeof(int32_t),
+              "network weights are stored raw");
+static_assert(HIDDEN % 32 == 0, "the avx2 kernels work in 32 byte rows");
+
+// enough for every piece on the board, a move changes far fewer
+const size_t MAX_CHANGES = 24;
+
+// feature of a piece as seen by one side, with the board turned around
+// for black so both sides see their own men moving the same way
+uint32_t feature(colour_e view, colour_e owner, bool king, uint32_t square)
+{
+    const uint32_t type = (owner == view ? 0 : 2) + (king ? 1 : 0);
+    return type * 32 + (view == WHITE ? square : 31 - square);
+}
+
+// first layer rows to add and subtract for one side's point of view
+struct delta_t
+{
+    uint32_t add[MAX_CHANGES];
+    uint32_t sub[MAX_CHANGES];
+    size_t adds;
+    size_t subs;
+};
+
+void push(uint32_t * out, size_t & count, uint32_t value)
+{
+    if (count < MAX_CHANGES) {
+        out[count++] = value;
+    }
+}
+
+// features that differ between two positions, from both points of view
+void changes(const bitboard_t & before,
+             const bitboard_t & after,
+             delta_t (&delta)[2])
+{
+    delta[WHITE].adds = delta[WHITE].subs = 0;
+    delta[BLACK].adds = delta[BLACK].subs = 0;
+    for (int32_t c = WHITE; c <= BLACK; ++c) {
+        const colour_e owner = colour_e(c);
+        for (int32_t k = 0; k < 2; ++k) {
+            const uint32_t kings_b = k ? before.kings : ~before.kings;
+            const uint32_t kings_a = k ? after.kings : ~after.kings;
+            const uint32_t b = before.pieces(owner) & kings_b;
+            const uint32_t a = after.pieces(owner) & kings_a;
+            for (uint32_t gone = b & ~a; gone; gone &= gone - 1) {
+                const uint32_t sq = uint32_t(bitboard_t::lsb(gone));
+                push(delta[WHITE].sub, delta[WHITE].subs, feature(WHITE, owner, k != 0, sq));
+                push(delta[BLACK].sub, delta[BLACK].subs, feature(BLACK, owner, k != 0, sq));
+            }
+            for (uint32_t come = a & ~b; come; come &= come - 1) {
+                const uint32_t sq = uint32_t(bitboard_t::lsb(come));
+                push(delta[WHITE].add, delta[WHITE].adds, feature(WHITE, owner, k != 0, sq));
+                push(delta[BLACK].add, delta[BLACK].adds, feature(BLACK, owner, k != 0, sq));
+            }
+        }
+    }
+}
+
+// replay one board_t event on a bitboard
+void apply_event(bitboard_t & b, const event_t & e)
+{
+    const int32_t s = bitboard_t::square(e.pos[0]);
+    if (s == EMPTY) {
+        return;
+    }
+    const uint32_t from = 1u << s;
+    switch (e.type) {
+    case (event_t::MOVE): {
+        const int32_t t = bitboard_t::square(e.pos[1]);
+        if (t == EMPTY) {
+            return;
+        }
+        const uint32_t to = 1u << t;
+        if (b.white & from) {
+            b.white = (b.white & ~from) | to;
+        }
+        if (b.black & from) {
+            b.black = (b.black & ~from) | to;
+        }
+        if (b.kings & from) {
+            b.kings = (b.kings & ~from) | to;
+        }
+        break;
+    }
+    case (event_t::CAPTURE):
+        b.white &= ~from;
+        b.black &= ~from;
+        b.kings &= ~from;
+        break;
+    case (event_t::CROWN):
+        b.kings |= from;
+        break;
+    default:
+        break;
+    }
+}
+
+typedef void (*accumulate_fn_t)(const weights_t & w,
+                                const int16_t * src,
+                                const delta_t & delta,
+                                int16_t * dst);
+
+typedef int32_t (*evaluate_fn_t)(const weights_t & w,
+                                 const int16_t * us,
+                                 const int16_t * them);
+
+void accumulate_scalar(const weights_t & w,
+                       const int16_t * src,
+                       const delta_t & delta,
+                       int16_t * dst)
+{
+    for (size_t h = 0; h < HIDDEN; ++h) {
+        int16_t v = src[h];
+        for (size_t i = 0; i < delta.adds; ++i) {
+            v = int16_t(v + w.l1_weight[delta.add[i]][h]);
+        }
+        for (size_t i = 0; i < delta.subs; ++i) {
+            v = int16_t(v - w.l1_weight[delta.sub[i]][h]);
+        }
+        dst[h] = v;
+    }
+}
+
+// the output layer, shared by every kernel
+int32_t output(const weights_t & w, const int32_t * l2)
+{
+    int32_t out = w.l3_bias;
+    for (size_t o = 0; o < L2; ++o) {
+        // back to the first layer scale and clipped
+        const int32_t h = std::min(std::max(l2[o] / QB, 0), QA);
+        out += h * w.l3_weight[o];
+    }
+    return out * nnue_t::SCALE / (QA * QB);
+}
+
+int32_t evaluate_scalar(const weights_t & w,
+                        const int16_t * us,
+                        const int16_t * them)
+{
+    uint8_t in[2 * HIDDEN];
+    for (size_t h = 0; h < HIDDEN; ++h) {
+        in[h] = uint8_t(std::min(std::max(int32_t(us[h]), 0), QA));
+        in[HIDDEN + h] = uint8_t(std::min(std::max(int32_t(them[h]), 0), QA));
+    }
+    int32_t l2[L2];
+    for (size_t o = 0; o < L2; ++o) {
+        int32_t sum = w.l2_bias[o];
+        for (size_t i = 0; i < 2 * HIDDEN; ++i) {
+            sum += int32_t(in[i]) * w.l2_weight[o][i];
+        }
+        l2[o] = sum;
+    }
+    return output(w, l2);
+}
+
+#if defined(NNUE_X86)
+
+TARGET("avx2")
+void accumulate_avx2(const weights_t & w,
+                     const int16_t * src,
+                     const delta_t & delta,
+                     int16_t * dst)
+{
+    // sixteen hidden units per register
+    for (size_t h = 0; h < HIDDEN; h += 16) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(src + h));
+        for (size_t i = 0; i < delta.adds; ++i) {
+            v = _mm256_add_epi16(v,
+                _mm256_loadu_si256((const __m256i *)(w.l1_weight[delta.add[i]] + h)));
+        }
+        for (size_t i = 0; i < delta.subs; ++i) {
+            v = _mm256_sub_epi16(v,
+                _mm256_loadu_si256((const __m256i *)(w.l1_weight[delta.sub[i]] + h)));
+        }
+        _mm256_storeu_si256((__m256i *)(dst + h), v);
+    }
+}
+
+// clip 32 accumulator values to 0..QA and pack them into bytes
+TARGET("avx2")
+inline __m256i clip_pack(const int16_t * v)
+{
+    const __m256i top = _mm256_set1_epi16(int16_t(QA));
+    const __m256i a = _mm256_min_epi16(_mm256_loadu_si256((const __m256i *)v), top);
+    const __m256i b = _mm256_min_epi16(_mm256_loadu_si256((const __m256i *)(v + 16)), top);
+    // packus clamps negatives to zero but interleaves the 128 bit lanes
+    return _mm256_permute4x64_epi64(_mm256_packus_epi16(a, b), 0xd8);
+}
+
+TARGET("avx2")
+int32_t evaluate_avx2(const weights_t & w,
+                      const int16_t * us,
+                      const int16_t * them)
+{
+    const size_t ROWS = 2 * HIDDEN / 32;
+    __m256i in[ROWS];
+    for (size_t r = 0; r < ROWS / 2; ++r) {
+        in[r] = clip_pack(us + r * 32);
+        in[ROWS / 2 + r] = clip_pack(them + r * 32);
+    }
+    const __m256i ones = _mm256_set1_epi16(1);
+    int32_t l2[L2];
+    for (size_t o = 0; o < L2; ++o) {
+        __m256i sum = _mm256_setzero_si256();
+        for (size_t r = 0; r < ROWS; ++r) {
+            const __m256i wr = _mm256_loadu_si256((const __m256i *)(w.l2_weight[o] + r * 32));
+            // u8 x s8 pairs into s16 then pairs of those into s32, the
+            // inputs are at most QA so the first step cannot saturate
+            sum = _mm256_add_epi32(sum,
+                _mm256_madd_epi16(_mm256_maddubs_epi16(in[r], wr), ones));
+        }
+        __m128i s = _mm_add_epi32(_mm256_castsi256_si128(sum),
+                                  _mm256_extracti128_si256(sum, 1));
+        s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0x4e));
+        s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0xb1));
+        l2[o] = w.l2_bias[o] + _mm_cvtsi128_si32(s);
+    }
+    return output(w, l2);
+}
+
+#endif // defined(NNUE_X86)
+
+} // namespace {}
+
+struct nnue_t::impl_t
+{
+    void * base;
+    size_t size;
+    const weights_t * weights;
+    accumulate_fn_t accumulate;
+    evaluate_fn_t evaluate;
+
+    impl_t()
+        : base(nullptr)
+        , size(0)
+        , weights(nullptr)
+        , accumulate(accumulate_scalar)
+        , evaluate(evaluate_scalar)
+    {
+    }
+
+    ~impl_t()
+    {
+        close();
+    }
+
+    void close()
+    {
+#if !defined(_MSC_VER)
+        if (base) {
+            munmap(base, size);
+        }
+#endif
+        base = nullptr;
+        weights = nullptr;
+        size = 0;
+    }
+
+    bool open(const char * path)
+    {
+        close();
+#if defined(_MSC_VER)
+        return false;
+#else
+        const int fd = ::open(path, O_RDONLY);
+        if (fd < 0) {
+            return false;
+        }
+        struct stat st;
+        if (fstat(fd, &st) != 0 ||
+            size_t(st.st_size) < WEIGHTS_OFFSET + sizeof(weights_t)) {
+            ::close(fd);
+            log(LOG_WARN, "nnue: bad network file '%s'", path);
+            return false;
+        }
+        void * map = mmap(nullptr, size_t(st.st_size), PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (map == MAP_FAILED) {
+            return false;
+        }
+        const nnue_header_t * header = (const nnue_header_t *)map;
+        if (memcmp(header->magic, NNUE_MAGIC, 4) != 0 ||
+            header->version != NNUE_VERSION ||
+            header->features != nnue_t::FEATURES ||
+            header->hidden != HIDDEN ||
+            header->l2 != L2) {
+            log(LOG_WARN, "nnue: bad network file '%s'", path);
+            munmap(map, size_t(st.st_size));
+            return false;
+        }
+        base = map;
+        size = size_t(st.st_size);
+        weights = (const weights_t *)((const uint8_t *)map + WEIGHTS_OFFSET);
+        return true;
+#endif
+    }
+
+    bool select(eval_t::isa_e isa)
+    {
+        switch (isa) {
+        case (eval_t::SCALAR):
+            accumulate = accumulate_scalar;
+            evaluate = evaluate_scalar;
+            return true;
+#if defined(NNUE_X86)
+        case (eval_t::AVX2):
+            if (!cpu_t::avx2()) {
+                return false;
+            }
+            accumulate = accumulate_avx2;
+            evaluate = evaluate_avx2;
+            return true;
+#endif
+        default:
+            return false;
+        }
+    }
+};
+
+nnue_t::nnue_t()
+    : imp_(new nnue_t::impl_t)
+{
+    // use the widest kernels this cpu has
+    for (int32_t isa = eval_t::NUM_ISA - 1; isa > eval_t::SCALAR; --isa) {
+        if (imp_->select(eval_t::isa_e(isa))) {
+            break;
+        }
+    }
+}
+
+nnue_t::~nnue_t()
+{
+    delete imp_;
+}
+
+bool nnue_t::open(const char * path)
+{
+    return imp_->open(path);
+}
+
+bool nnue_t::select(eval_t::isa_e isa)
+{
+    return imp_->select(isa);
+}
+
+void nnue_t::refresh(const bitboard_t & pos, accumulator_t & out) const
+{
+    assert(imp_->weights);
+    // every piece is added to the bias
+    const bitboard_t none = {0, 0, 0};
+    delta_t delta[2];
+    changes(none, pos, delta);
+    for (int32_t view = WHITE; view <= BLACK; ++view) {
+        imp_->accumulate(*imp_->weights, imp_->weights->l1_bias, delta[view], out.v[view]);
+    }
+}
+
+void nnue_t::update(const accumulator_t & parent,
+                    const bitboard_t & pos,
+                    const bitmove_t & move,
+                    colour_e turn,
+                    accumulator_t & out) const
+{
+    assert(imp_->weights);
+    bitboard_t after = pos;
+    after.apply(move, turn);
+    delta_t delta[2];
+    changes(pos, after, delta);
+    for (int32_t view = WHITE; view <= BLACK; ++view) {
+        imp_->accumulate(*imp_->weights, parent.v[view], delta[view], out.v[view]);
+    }
+}
+
+void nnue_t::update(accumulator_t & acc,
+                    const bitboard_t & before,
+                    const event_list_t & events) const
+{
+    assert(imp_->weights);
+    bitboard_t after = before;
+    for (const event_t & e : events) {
+        apply_event(after, e);
+    }
+    delta_t delta[2];
+    changes(before, after, delta);
+    for (int32_t view = WHITE; view <= BLACK; ++view) {
+        imp_->accumulate(*imp_->weights, acc.v[view], delta[view], acc.v[view]);
+    }
+}
+
+int32_t nnue_t::evaluate(const accumulator_t & acc, colour_e turn) const
+{
+    assert(imp_->weights);
+    const colour_e other = (turn == WHITE) ? BLACK : WHITE;
+    return imp_->evaluate(*imp_->weights, acc.v[turn], acc.v[other]);
+}
+
+bool nnue_t::save(const char * path, const weights_t & weights)
+{
+    FILE * fd = fopen(path, "wb");
+    if (!fd) {
+        log(LOG_ERROR, "nnue: unable to write '%s'", path);
+        return false;
+    }
+    uint8_t head[WEIGHTS_OFFSET] = {0};
+    nnue_header_t header;
+    memcpy(header.magic, NNUE_MAGIC, 4);
+    header.version = NNUE_VERSION;
+    header.features = FEATURES;
+    header.hidden = HIDDEN;
+    header.l2 = L2;
+    memcpy(head, &header, sizeof(header));
+    bool ok = fwrite(head, sizeof(head), 1, fd) == 1;
+    ok = ok && fwrite(&weights, sizeof(weights), 1, fd) == 1;
+    ok = (fclose(fd) == 0) && ok;
+    if (!ok) {
+        log(LOG_ERROR, "nnue: unable to write '%s'", path);
+    }
+    return ok;
+}
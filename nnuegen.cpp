@@ -0,0 +1,378 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "checkers.h"
+
+namespace {
+
+const size_t FEATURES = nnue_t::FEATURES;
+const size_t HIDDEN = nnue_t::HIDDEN;
+const size_t L2 = nnue_t::L2;
+const size_t INPUTS = 2 * HIDDEN;
+// positions per gradient step
+const size_t BATCH = 256;
+// later layer weights must fit an int8 at the QB scale
+const float MAX_WEIGHT = 127.f / float(nnue_t::QB);
+// first layer weights are kept small enough that 24 of them and the
+// bias fit an int16 at the QA scale
+const float MAX_L1_WEIGHT = 8.f;
+// targets beyond this many men are treated as won
+const float MAX_TARGET = 15.f;
+
+// a training position, its features from the side to move's view first
+struct sample_t
+{
+    bitboard_t pos;
+    colour_e turn;
+    uint8_t features[2][24];
+    uint8_t counts[2];
+    // score for the side to move in men
+    float target;
+};
+
+// the same feature numbering as nnue.cpp
+uint32_t feature(colour_e view, colour_e owner, bool king, uint32_t square)
+{
+    const uint32_t type = (owner == view ? 0 : 2) + (king ? 1 : 0);
+    return type * 32 + (view == WHITE ? square : 31 - square);
+}
+
+void to_sample(const bitboard_t & pos, colour_e turn, float target, sample_t & out)
+{
+    out.pos = pos;
+    out.turn = turn;
+    const colour_e views[2] = {turn, turn == WHITE ? BLACK : WHITE};
+    for (size_t v = 0; v < 2; ++v) {
+        out.counts[v] = 0;
+        for (int32_t c = WHITE; c <= BLACK; ++c) {
+            for (uint32_t m = pos.pieces(colour_e(c)); m; m &= m - 1) {
+                const uint32_t sq = uint32_t(bitboard_t::lsb(m));
+                const bool king = (pos.kings >> sq) & 1;
+                out.features[v][out.counts[v]++] =
+                    uint8_t(feature(views[v], colour_e(c), king, sq));
+            }
+        }
+    }
+    out.target = std::min(std::max(target, -MAX_TARGET), MAX_TARGET);
+}
+
+// quiet positions from random games, scored by the hand written
+// evaluation or by a search
+bool generate(size_t count,
+              int32_t depth,
+              std::mt19937 & random,
+              std::vector<sample_t> & out)
+{
+    std::unique_ptr<search_t> search;
+    if (depth > 0) {
+        search.reset(new search_t);
+        search->set_hash_size(16);
+    }
+    out.clear();
+    while (out.size() < count) {
+        board_t board;
+        board.reset();
+        bitboard_t pos = board.bits;
+        colour_e turn = BLACK;
+        const int32_t plies = int32_t(random() % 120);
+        for (int32_t ply = 0; ply < plies && out.size() < count; ++ply) {
+            move_list_t list;
+            if (!pos.generate(turn, list) || list.size == 0) {
+                break;
+            }
+            // positions with a capture pending are not worth learning
+            if (list.move[0].taken == 0 && (random() & 3) == 0) {
+                int32_t score = eval_t::evaluate(pos, turn);
+                if (search) {
+                    search_limits_t limits = {depth, 0};
+                    bitmove_t best;
+                    search_info_t info;
+                    if (!search->think(pos, turn, limits, best, info)) {
+                        break;
+                    }
+                    score = info.score;
+                }
+                sample_t s;
+                to_sample(pos, turn, float(score) / float(nnue_t::SCALE), s);
+                out.push_back(s);
+                if (out.size() % 10000 == 0) {
+                    printf("\r%llu positions", (unsigned long long)out.size());
+                    fflush(stdout);
+                }
+            }
+            pos.apply(list.move[random() % list.size], turn);
+            turn = (turn == WHITE) ? BLACK : WHITE;
+        }
+    }
+    printf("\r%llu positions\n", (unsigned long long)out.size());
+    return true;
+}
+
+// a float copy of the network trained with adam
+struct trainer_t
+{
+    // parameters laid out as l1 weights, l1 bias, l2 weights, l2 bias,
+    // l3 weights, l3 bias
+    std::vector<float> param, grad, m, v;
+    float * w1, * b1, * w2, * b2, * w3, * b3;
+    int64_t steps;
+
+    trainer_t(std::mt19937 & random)
+        : param(FEATURES * HIDDEN + HIDDEN + L2 * INPUTS + L2 + L2 + 1)
+        , grad(param.size())
+        , m(param.size())
+        , v(param.size())
+        , steps(0)
+    {
+        w1 = param.data();
+        b1 = w1 + FEATURES * HIDDEN;
+        w2 = b1 + HIDDEN;
+        b2 = w2 + L2 * INPUTS;
+        w3 = b2 + L2;
+        b3 = w3 + L2;
+        std::normal_distribution<float> normal(0.f, 1.f);
+        for (size_t i = 0; i < FEATURES * HIDDEN; ++i) {
+            w1[i] = normal(random) * 0.1f;
+        }
+        for (size_t i = 0; i < HIDDEN; ++i) {
+            b1[i] = 0.1f;
+        }
+        for (size_t i = 0; i < L2 * INPUTS; ++i) {
+            w2[i] = normal(random) * std::sqrt(1.f / float(INPUTS));
+        }
+        for (size_t i = 0; i < L2; ++i) {
+            b2[i] = 0.1f;
+            w3[i] = normal(random) * std::sqrt(1.f / float(L2));
+        }
+        *b3 = 0.f;
+    }
+
+    // forward and backward pass for one sample, returns the squared error
+    float step(const sample_t & s)
+    {
+        float acc[INPUTS], x[INPUTS], z2[L2], y2[L2];
+        for (size_t v = 0; v < 2; ++v) {
+            float * a = acc + v * HIDDEN;
+            std::copy(b1, b1 + HIDDEN, a);
+            for (size_t i = 0; i < s.counts[v]; ++i) {
+                const float * row = w1 + s.features[v][i] * HIDDEN;
+                for (size_t h = 0; h < HIDDEN; ++h) {
+                    a[h] += row[h];
+                }
+            }
+        }
+        for (size_t i = 0; i < INPUTS; ++i) {
+            x[i] = std::min(std::max(acc[i], 0.f), 1.f);
+        }
+        float out = *b3;
+        for (size_t o = 0; o < L2; ++o) {
+            const float * row = w2 + o * INPUTS;
+            float sum = b2[o];
+            for (size_t i = 0; i < INPUTS; ++i) {
+                sum += row[i] * x[i];
+            }
+            z2[o] = sum;
+            y2[o] = std::min(std::max(sum, 0.f), 1.f);
+            out += w3[o] * y2[o];
+        }
+        const float error = out - s.target;
+        // backward
+        float * gw1 = grad.data();
+        float * gb1 = gw1 + FEATURES * HIDDEN;
+        float * gw2 = gb1 + HIDDEN;
+        float * gb2 = gw2 + L2 * INPUTS;
+        float * gw3 = gb2 + L2;
+        float * gb3 = gw3 + L2;
+        const float dout = 2.f * error;
+        *gb3 += dout;
+        float dx[INPUTS] = {0.f};
+        for (size_t o = 0; o < L2; ++o) {
+            gw3[o] += dout * y2[o];
+            if (z2[o] <= 0.f || z2[o] >= 1.f) {
+                continue;
+            }
+            const float dz = dout * w3[o];
+            gb2[o] += dz;
+            const float * row = w2 + o * INPUTS;
+            float * grow = gw2 + o * INPUTS;
+            for (size_t i = 0; i < INPUTS; ++i) {
+                grow[i] += dz * x[i];
+                dx[i] += dz * row[i];
+            }
+        }
+        for (size_t v = 0; v < 2; ++v) {
+            float da[HIDDEN];
+            for (size_t h = 0; h < HIDDEN; ++h) {
+                const float a = acc[v * HIDDEN + h];
+                da[h] = (a > 0.f && a < 1.f) ? dx[v * HIDDEN + h] : 0.f;
+                gb1[h] += da[h];
+            }
+            for (size_t i = 0; i < s.counts[v]; ++i) {
+                float * grow = gw1 + s.features[v][i] * HIDDEN;
+                for (size_t h = 0; h < HIDDEN; ++h) {
+                    grow[h] += da[h];
+                }
+            }
+        }
+        return error * error;
+    }
+
+    void apply(float rate, size_t count)
+    {
+        const float b1_decay = 0.9f, b2_decay = 0.999f;
+        ++steps;
+        const float c1 = 1.f - std::pow(b1_decay, float(steps));
+        const float c2 = 1.f - std::pow(b2_decay, float(steps));
+        for (size_t i = 0; i < param.size(); ++i) {
+            const float g = grad[i] / float(count);
+            m[i] = b1_decay * m[i] + (1.f - b1_decay) * g;
+            v[i] = b2_decay * v[i] + (1.f - b2_decay) * g * g;
+            param[i] -= rate * (m[i] / c1) / (std::sqrt(v[i] / c2) + 1e-8f);
+            grad[i] = 0.f;
+        }
+        // keep every weight representable once quantized
+        for (size_t i = 0; i < FEATURES * HIDDEN + HIDDEN; ++i) {
+            w1[i] = std::min(std::max(w1[i], -MAX_L1_WEIGHT), MAX_L1_WEIGHT);
+        }
+        for (size_t i = 0; i < L2 * INPUTS; ++i) {
+            w2[i] = std::min(std::max(w2[i], -MAX_WEIGHT), MAX_WEIGHT);
+        }
+        for (size_t i = 0; i < L2; ++i) {
+            w3[i] = std::min(std::max(w3[i], -MAX_WEIGHT), MAX_WEIGHT);
+        }
+    }
+
+    template <typename type_t>
+    static type_t quantize(float value, float scale, float limit)
+    {
+        const float q = std::round(value * scale);
+        return type_t(std::min(std::max(q, -limit), limit));
+    }
+
+    void export_weights(nnue_t::weights_t & out) const
+    {
+        const float qa = float(nnue_t::QA), qb = float(nnue_t::QB);
+        for (size_t f = 0; f < FEATURES; ++f) {
+            for (size_t h = 0; h < HIDDEN; ++h) {
+                out.l1_weight[f][h] = quantize<int16_t>(w1[f * HIDDEN + h], qa, 32767.f);
+            }
+        }
+        for (size_t h = 0; h < HIDDEN; ++h) {
+            out.l1_bias[h] = quantize<int16_t>(b1[h], qa, 32767.f);
+        }
+        for (size_t o = 0; o < L2; ++o) {
+            for (size_t i = 0; i < INPUTS; ++i) {
+                out.l2_weight[o][i] = quantize<int8_t>(w2[o * INPUTS + i], qb, 127.f);
+            }
+            out.l2_bias[o] = quantize<int32_t>(b2[o], qa * qb, 1e9f);
+            out.l3_weight[o] = quantize<int8_t>(w3[o], qb, 127.f);
+        }
+        out.l3_bias = quantize<int32_t>(*b3, qa * qb, 1e9f);
+    }
+};
+
+// rms error in evaluation units of the quantized network on some samples
+double quantized_error(const nnue_t & net, const std::vector<sample_t> & samples)
+{
+    double sum = 0.0;
+    nnue_t::accumulator_t acc;
+    for (const sample_t & s : samples) {
+        net.refresh(s.pos, acc);
+        const double error = double(net.evaluate(acc, s.turn)) -
+                             double(s.target) * nnue_t::SCALE;
+        sum += error * error;
+    }
+    return samples.empty() ? 0.0 : std::sqrt(sum / double(samples.size()));
+}
+
+void usage()
+{
+    printf("usage: checkers_nnue [options]\n");
+    printf("  -o <file>        network file to write (default net.ckn)\n");
+    printf("  -positions <n>   training positions (default 200000)\n");
+    printf("  -epochs <n>      passes over the positions (default 10)\n");
+    printf("  -depth <n>       score positions with a search this deep instead\n");
+    printf("                   of the hand written evaluation (default 0)\n");
+    printf("  -seed <n>        seed for the random games\n");
+}
+
+} // namespace {}
+
+int main(int argc, char * args[])
+{
+    const char * out = "net.ckn";
+    size_t positions = 200000;
+    int32_t epochs = 10;
+    int32_t depth = 0;
+    uint32_t seed = 1;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(args[i], "-o") == 0 && i+1 < argc) {
+            out = args[++i];
+        }
+        else if (strcmp(args[i], "-positions") == 0 && i+1 < argc) {
+            positions = size_t(std::max(1, atoi(args[++i])));
+        }
+        else if (strcmp(args[i], "-epochs") == 0 && i+1 < argc) {
+            epochs = atoi(args[++i]);
+        }
+        else if (strcmp(args[i], "-depth") == 0 && i+1 < argc) {
+            depth = atoi(args[++i]);
+        }
+        else if (strcmp(args[i], "-seed") == 0 && i+1 < argc) {
+            seed = uint32_t(strtoul(args[++i], nullptr, 10));
+        }
+        else {
+            usage();
+            return 1;
+        }
+    }
+    std::mt19937 random(seed);
+    std::vector<sample_t> samples;
+    if (!generate(positions, depth, random, samples)) {
+        return 1;
+    }
+    trainer_t trainer(random);
+    float rate = 1e-3f;
+    for (int32_t epoch = 0; epoch < epochs; ++epoch) {
+        std::shuffle(samples.begin(), samples.end(), random);
+        double loss = 0.0;
+        for (size_t i = 0; i < samples.size(); i += BATCH) {
+            const size_t end = std::min(samples.size(), i + BATCH);
+            for (size_t j = i; j < end; ++j) {
+                loss += trainer.step(samples[j]);
+            }
+            trainer.apply(rate, end - i);
+        }
+        printf("epoch %d  rms error %.1f\n", epoch + 1,
+               std::sqrt(loss / double(samples.size())) * nnue_t::SCALE);
+        // settle down over the last few passes
+        if (epoch >= epochs / 2) {
+            rate *= 0.7f;
+        }
+    }
+    std::unique_ptr<nnue_t::weights_t> weights(new nnue_t::weights_t);
+    trainer.export_weights(*weights);
+    if (!nnue_t::save(out, *weights)) {
+        return 1;
+    }
+    // check the file as the engine will read it, on fresh positions
+    nnue_t net;
+    if (!net.open(out)) {
+        printf("unable to read back '%s'\n", out);
+        return 1;
+    }
+    std::vector<sample_t> check;
+    if (!generate(2000, depth, random, check)) {
+        return 1;
+    }
+    printf("quantized rms error on new positions %.1f\n",
+           quantized_error(net, check));
+    printf("wrote '%s'\n", out);
+    return 0;
+}
@@ -0,0 +1,30 @@
+#include "checkers.h"
+
+// renderer for machines without a display, drops every event
+struct null_render_t : public render_t
+{
+    virtual bool init()
+    {
+        return true;
+    }
+
+    virtual bool tick()
+    {
+        return true;
+    }
+
+    virtual bool push_event(const event_t & event)
+    {
+        return true;
+    }
+
+    virtual bool set_pieces(const board_t & board)
+    {
+        return true;
+    }
+};
+
+render_t * new_null_render()
+{
+    return new null_render_t;
+}
@@ -0,0 +1,621 @@
+#if !defined(_MSC_VER)
+ #include <fcntl.h>
+ #include <sys/mman.h>
+ #include <sys/stat.h>
+ #include <unistd.h>
+#endif
+
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+#include "checkers.h"
+
+namespace {
+
+// most squares written for one move, e.g. "1x10x19x28"
+const size_t MAX_MOVE_TOKENS = bitmove_t::MAX_HOPS + 1;
+
+bool is_space(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+// characters that end a bare token
+bool is_delimiter(char c)
+{
+    return is_space(c) || c == '[' || c == '{' || c == '(' || c == ';';
+}
+
+bool token_is(const char * begin, const char * end, const char * text)
+{
+    const size_t size = strlen(text);
+    return size_t(end - begin) == size && memcmp(begin, text, size) == 0;
+}
+
+// map a result token such as "1-0" to a game result
+bool parse_result(const char * begin, const char * end, pdn_game_t::result_e & out)
+{
+    // PDN results are given as white's score then black's
+    if (token_is(begin, end, "1-0") || token_is(begin, end, "2-0")) {
+        out = pdn_game_t::WHITE_WIN;
+    }
+    else if (token_is(begin, end, "0-1") || token_is(begin, end, "0-2")) {
+        out = pdn_game_t::BLACK_WIN;
+    }
+    else if (token_is(begin, end, "1/2-1/2") || token_is(begin, end, "1-1")) {
+        out = pdn_game_t::DRAW;
+    }
+    else if (token_is(begin, end, "*")) {
+        out = pdn_game_t::UNKNOWN;
+    }
+    else {
+        return false;
+    }
+    return true;
+}
+
+// find the legal move written as PDN squares, where a capture may list
+// only its start and end or every square it lands on
+bool find_move(const bitboard_t & pos,
+               colour_e turn,
+               const int32_t * squares,
+               size_t count,
+               bitmove_t & out)
+{
+    move_list_t list;
+    if (count < 2 || !pos.generate(turn, list)) {
+        return false;
+    }
+    for (size_t i = 0; i < list.size; ++i) {
+        const bitmove_t & m = list.move[i];
+        if (m.from != squares[0] || m.to() != squares[count-1]) {
+            continue;
+        }
+        // any intermediate squares given must be landed on in order
+        size_t next = 1;
+        for (size_t h = 0; h + 1 < m.hops && next + 1 < count; ++h) {
+            if (m.path[h] == squares[next]) {
+                ++next;
+            }
+        }
+        if (next + 1 == count) {
+            out = m;
+            return true;
+        }
+    }
+    return false;
+}
+
+// PDN result token for a game result
+const char * result_token(pdn_game_t::result_e result)
+{
+    switch (result) {
+    case (pdn_game_t::WHITE_WIN):
+        return "1-0";
+    case (pdn_game_t::BLACK_WIN):
+        return "0-1";
+    case (pdn_game_t::DRAW):
+        return "1/2-1/2";
+    default:
+        return "*";
+    }
+}
+
+// write a move as PDN squares, listing every landing square only when
+// the start and end alone would not say which capture was made
+bool move_text(const bitboard_t & pos,
+               colour_e turn,
+               const bitmove_t & move,
+               std::string & out)
+{
+    move_list_t list;
+    if (!pos.generate(turn, list)) {
+        return false;
+    }
+    bool legal = false, ambiguous = false;
+    for (size_t i = 0; i < list.size; ++i) {
+        const bitmove_t & m = list.move[i];
+        if (m == move) {
+            legal = true;
+        }
+        else if (m.from == move.from && m.to() == move.to()) {
+            ambiguous = true;
+        }
+    }
+    if (!legal) {
+        return false;
+    }
+    out = std::to_string(bitboard_t::to_pdn(move.from));
+    if (!move.taken) {
+        out += "-";
+        out += std::to_string(bitboard_t::to_pdn(move.to()));
+        return true;
+    }
+    for (size_t h = ambiguous ? 0 : move.hops - 1; h < move.hops; ++h) {
+        out += "x";
+        out += std::to_string(bitboard_t::to_pdn(move.path[h]));
+    }
+    return true;
+}
+
+// longest line of movetext written
+const size_t MAX_LINE = 79;
+
+} // namespace {}
+
+struct pdn_reader_t::impl_t
+{
+    // whole file, memory mapped where possible
+    const char * data;
+    size_t size;
+    size_t offset;
+    void * mapping;
+    std::vector<char> buffer;
+    uint64_t skipped;
+
+    impl_t()
+        : data(nullptr)
+        , size(0)
+        , offset(0)
+        , mapping(nullptr)
+        , skipped(0)
+    {
+    }
+
+    ~impl_t()
+    {
+        close();
+    }
+
+    void close()
+    {
+#if !defined(_MSC_VER)
+        if (mapping) {
+            munmap(mapping, size);
+        }
+#endif
+        mapping = nullptr;
+        buffer.clear();
+        data = nullptr;
+        size = offset = 0;
+    }
+
+    bool open(const char * path)
+    {
+        close();
+#if !defined(_MSC_VER)
+        const int fd = ::open(path, O_RDONLY);
+        if (fd < 0) {
+            return false;
+        }
+        struct stat st;
+        if (fstat(fd, &st) != 0) {
+            ::close(fd);
+            return false;
+        }
+        size = size_t(st.st_size);
+        if (size == 0) {
+            ::close(fd);
+            return true;
+        }
+        void * base = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (base == MAP_FAILED) {
+            size = 0;
+            return false;
+        }
+        // games are read front to back exactly once
+        madvise(base, size, MADV_SEQUENTIAL);
+        mapping = base;
+        data = (const char *)base;
+        return true;
+#else
+        FILE * fd = fopen(path, "rb");
+        if (!fd) {
+            return false;
+        }
+        char chunk[1 << 16];
+        size_t got;
+        while ((got = fread(chunk, 1, sizeof(chunk), fd)) > 0) {
+            buffer.insert(buffer.end(), chunk, chunk + got);
+        }
+        fclose(fd);
+        data = buffer.data();
+        size = buffer.size();
+        return true;
+#endif
+    }
+
+    // skip a {comment}, (variation) or ; line comment
+    void skip_comment()
+    {
+        const char open = data[offset++];
+        if (open == ';') {
+            while (offset < size && data[offset] != '\n') {
+                ++offset;
+            }
+            return;
+        }
+        const char close = (open == '{') ? '}' : ')';
+        int32_t depth = 1;
+        while (offset < size && depth) {
+            const char c = data[offset++];
+            // only variations nest
+            depth += (c == open && open == '(') ? 1 : 0;
+            depth -= (c == close) ? 1 : 0;
+        }
+    }
+
+    // parse a [Name "value"] tag
+    void read_tag(pdn_game_t & game, bool & broken)
+    {
+        ++offset;
+        const size_t name = offset;
+        while (offset < size && !is_space(data[offset]) &&
+               data[offset] != '"' && data[offset] != ']') {
+            ++offset;
+        }
+        const size_t name_end = offset;
+        std::string value;
+        while (offset < size && data[offset] != '"' && data[offset] != ']') {
+            ++offset;
+        }
+        if (offset < size && data[offset] == '"') {
+            ++offset;
+            while (offset < size && data[offset] != '"') {
+                value += data[offset++];
+            }
+        }
+        while (offset < size && data[offset] != ']') {
+            ++offset;
+        }
+        ++offset;
+        const char * n = data + name;
+        const char * n_end = data + name_end;
+        if (token_is(n, n_end, "FEN")) {
+            broken |= !game.start.from_fen(value.c_str(), game.turn);
+        }
+        else if (token_is(n, n_end, "Result")) {
+            parse_result(value.data(), value.data() + value.size(), game.result);
+        }
+    }
+
+    // apply a move token such as "11-15" or "22x15x8"
+    bool read_move(const char * begin,
+                   const char * end,
+                   pdn_game_t & game,
+                   bitboard_t & pos,
+                   colour_e & turn)
+    {
+        int32_t squares[MAX_MOVE_TOKENS];
+        size_t count = 0;
+        int32_t number = 0;
+        bool digits = false;
+        for (const char * c = begin; c <= end; ++c) {
+            const char ch = (c < end) ? *c : '\0';
+            if (ch >= '0' && ch <= '9') {
+                number = number*10 + (ch-'0');
+                digits = true;
+                continue;
+            }
+            if (digits) {
+                if (number < 1 || number > 32 || count == MAX_MOVE_TOKENS) {
+                    return false;
+                }
+                squares[count++] = bitboard_t::from_pdn(number);
+                number = 0;
+                digits = false;
+            }
+            // anything other than a separator is an annotation such as "!?"
+            if (ch != '-' && ch != 'x' && ch != ':') {
+                break;
+            }
+        }
+        bitmove_t move;
+        if (!find_move(pos, turn, squares, count, move)) {
+            return false;
+        }
+        pos.apply(move, turn);
+        turn = (turn == WHITE) ? BLACK : WHITE;
+        game.moves.push_back(move);
+        return true;
+    }
+
+    bool next(pdn_game_t & game)
+    {
+        board_t board;
+        board.reset();
+        for (;;) {
+            game.start = board.bits;
+            game.turn = BLACK;
+            game.moves.clear();
+            game.result = pdn_game_t::UNKNOWN;
+            bitboard_t pos;
+            colour_e turn = BLACK;
+            bool started = false, in_moves = false, broken = false, done = false;
+            while (!done) {
+                while (offset < size && is_space(data[offset])) {
+                    ++offset;
+                }
+                if (offset >= size) {
+                    break;
+                }
+                const char c = data[offset];
+                if (c == '[') {
+                    // a tag after the moves starts the next game
+                    if (in_moves) {
+                        break;
+                    }
+                    read_tag(game, broken);
+                    started = true;
+                    continue;
+                }
+                if (c == '{' || c == '(' || c == ';') {
+                    skip_comment();
+                    continue;
+                }
+                const char * begin = data + offset;
+                while (offset < size && !is_delimiter(data[offset])) {
+                    ++offset;
+                }
+                const char * end = data + offset;
+                if (!in_moves) {
+                    // tags are all read so the position is settled
+                    pos = game.start;
+                    turn = game.turn;
+                    in_moves = started = true;
+                }
+                if (parse_result(begin, end, game.result)) {
+                    done = true;
+                    continue;
+                }
+                // skip move numbers such as "12." or "12..." and NAGs
+                const char * dot = begin;
+                while (dot < end && *dot != '.') {
+                    ++dot;
+                }
+                if (dot < end) {
+                    while (dot < end && *dot == '.') {
+                        ++dot;
+                    }
+                    begin = dot;
+                }
+                if (begin == end || *begin == '$') {
+                    continue;
+                }
+                if (!broken && !read_move(begin, end, game, pos, turn)) {
+                    broken = true;
+                }
+            }
+            if (!started) {
+                return false;
+            }
+            if (!broken) {
+                return true;
+            }
+            ++skipped;
+        }
+    }
+};
+
+pdn_reader_t::pdn_reader_t()
+    : imp_(new pdn_reader_t::impl_t)
+{
+}
+
+pdn_reader_t::~pdn_reader_t()
+{
+    delete imp_;
+}
+
+bool pdn_reader_t::open(const char * path)
+{
+    return imp_->open(path);
+}
+
+bool pdn_reader_t::next(pdn_game_t & out)
+{
+    return imp_->next(out);
+}
+
+uint64_t pdn_reader_t::skipped() const
+{
+    return imp_->skipped;
+}
+
+struct pdn_writer_t::impl_t
+{
+    FILE * file;
+    std::thread worker;
+    std::mutex lock;
+    std::condition_variable wake;
+    // games waiting to be written, guarded by lock
+    std::deque<pdn_game_t> queue;
+    bool stopping;
+    // round number given to the next game written
+    uint64_t round;
+    std::atomic<uint64_t> written;
+
+    impl_t()
+        : file(nullptr)
+        , stopping(false)
+        , round(1)
+        , written(0)
+    {
+    }
+
+    ~impl_t()
+    {
+        close();
+    }
+
+    bool open(const char * path)
+    {
+        close();
+        // only ever append so earlier games are never touched
+        file = fopen(path, "ab");
+        if (!file) {
+            return false;
+        }
+        stopping = false;
+        worker = std::thread(&impl_t::run, this);
+        return true;
+    }
+
+    bool write(const pdn_game_t & game)
+    {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            if (!file || stopping) {
+                return false;
+            }
+            queue.push_back(game);
+        }
+        wake.notify_one();
+        return true;
+    }
+
+    void close()
+    {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            stopping = true;
+        }
+        wake.notify_one();
+        if (worker.joinable()) {
+            worker.join();
+        }
+        if (file) {
+            fclose(file);
+            file = nullptr;
+        }
+    }
+
+    void run()
+    {
+        std::deque<pdn_game_t> batch;
+        std::string text;
+        for (;;) {
+            {
+                std::unique_lock<std::mutex> guard(lock);
+                wake.wait(guard, [this] { return stopping || !queue.empty(); });
+                if (queue.empty()) {
+                    // stopping with nothing left to write
+                    return;
+                }
+                // take everything queued so the lock is not held over I/O
+                batch.swap(queue);
+            }
+            for (const pdn_game_t & game : batch) {
+                if (!pdn_writer_t::format(game, round, text)) {
+                    log(LOG_WARN, "pdn: dropped a game with an illegal move");
+                    continue;
+                }
+                ++round;
+                if (fwrite(text.data(), 1, text.size(), file) != text.size()) {
+                    log(LOG_ERROR, "pdn: write failed");
+                }
+            }
+            fflush(file);
+            written += batch.size();
+            batch.clear();
+        }
+    }
+};
+
+pdn_writer_t::pdn_writer_t()
+    : imp_(new pdn_writer_t::impl_t)
+{
+}
+
+pdn_writer_t::~pdn_writer_t()
+{
+    delete imp_;
+}
+
+bool pdn_writer_t::open(const char * path)
+{
+    return imp_->open(path);
+}
+
+bool pdn_writer_t::write(const pdn_game_t & game)
+{
+    return imp_->write(game);
+}
+
+void pdn_writer_t::close()
+{
+    imp_->close();
+}
+
+uint64_t pdn_writer_t::written() const
+{
+    return imp_->written;
+}
+
+bool pdn_writer_t::format(const pdn_game_t & game,
+                          uint64_t round,
+                          std::string & out)
+{
+    out = "[Event \"checkers\"]\n[Round \"";
+    out += std::to_string(round);
+    out += "\"]\n[Result \"";
+    out += result_token(game.result);
+    out += "\"]\n";
+    // games from the usual start with black to move need no position
+    board_t board;
+    board.reset();
+    if (!(game.start == board.bits) || game.turn != BLACK) {
+        std::string fen;
+        game.start.to_fen(game.turn, fen);
+        out += "[FEN \"" + fen + "\"]\n";
+    }
+    out += "\n";
+    bitboard_t pos = game.start;
+    colour_e turn = game.turn;
+    int32_t number = 1;
+    size_t line = 0;
+    std::string token, text;
+    // append a token, wrapping lines that would grow too long
+    auto emit = [&](const std::string & t) {
+        if (line && line + 1 + t.size() > MAX_LINE) {
+            out += "\n";
+            line = 0;
+        }
+        else if (line) {
+            out += " ";
+            ++line;
+        }
+        out += t;
+        line += t.size();
+    };
+    for (size_t i = 0; i < game.moves.size(); ++i) {
+        const bitmove_t & m = game.moves[i];
+        if (!move_text(pos, turn, m, text)) {
+            return false;
+        }
+        // move numbers count pairs of moves, black moving first
+        if (turn == BLACK) {
+            token = std::to_string(number) + ". " + text;
+        }
+        else if (i == 0) {
+            token = std::to_string(number) + "... " + text;
+        }
+        else {
+            token = text;
+        }
+        emit(token);
+        pos.apply(m, turn);
+        if (turn == WHITE) {
+            ++number;
+        }
+        turn = (turn == WHITE) ? BLACK : WHITE;
+    }
+    emit(result_token(game.result));
+    out += "\n\n";
+    return true;
+}
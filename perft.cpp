@@ -0,0 +1,185 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <vector>
+
+#include "checkers.h"
+
+namespace {
+
+// known leaf counts from the starting position
+const uint64_t START_PERFT[] = {
+    1ull,
+    7ull,
+    49ull,
+    302ull,
+    1469ull,
+    7361ull,
+    36768ull,
+    179740ull,
+    845931ull,
+    3963680ull,
+    18391564ull,
+    85242128ull,
+    388623673ull,
+};
+const int32_t START_PERFT_DEPTH = sizeof(START_PERFT)/sizeof(START_PERFT[0]);
+
+struct options_t
+{
+    int32_t depth;
+    // count moves at the last ply instead of making them
+    bool bulk;
+    // make moves with board_t::move rather than on the bitboard
+    bool board;
+};
+
+colour_e opponent(colour_e c)
+{
+    return c == WHITE ? BLACK : WHITE;
+}
+
+uint64_t perft_bits(const bitboard_t & bits,
+                    colour_e turn,
+                    int32_t depth,
+                    bool bulk)
+{
+    if (depth == 0) {
+        return 1;
+    }
+    move_list_t list;
+    if (!bits.generate(turn, list)) {
+        assert(!"move list overflow");
+        return 0;
+    }
+    if (bulk && depth == 1) {
+        return list.size;
+    }
+    uint64_t nodes = 0;
+    for (size_t i = 0; i < list.size; ++i) {
+        bitboard_t child = bits;
+        child.apply(list.move[i], turn);
+        nodes += perft_bits(child, opponent(turn), depth-1, bulk);
+    }
+    return nodes;
+}
+
+uint64_t perft_board(board_t & board,
+                     colour_e turn,
+                     int32_t depth,
+                     bool bulk)
+{
+    if (depth == 0) {
+        return 1;
+    }
+    move_list_t list;
+    if (!board.bits.generate(turn, list)) {
+        assert(!"move list overflow");
+        return 0;
+    }
+    if (bulk && depth == 1) {
+        return list.size;
+    }
+    uint64_t nodes = 0;
+    event_list_t events;
+    move_t move;
+    undo_t undo;
+    for (size_t i = 0; i < list.size; ++i) {
+        list.move[i].to_move(move);
+        // apply the move in place as the referee would
+        if (!board.make(move, turn, events, undo)) {
+            assert(!"legal move rejected by the board");
+            return 0;
+        }
+        events.clear();
+        nodes += perft_board(board, opponent(turn), depth-1, bulk);
+        board.unmake(undo);
+    }
+    return nodes;
+}
+
+bool run(const char * fen, const options_t & opt)
+{
+    board_t board;
+    colour_e turn = BLACK;
+    // use the starting position if no FEN was given
+    if (fen) {
+        bitboard_t bits;
+        if (!bits.from_fen(fen, turn) || !bits.to_board(board)) {
+            printf("unable to parse position '%s'\n", fen);
+            return false;
+        }
+    }
+    else {
+        board.reset();
+    }
+    std::string fen_out;
+    board.bits.to_fen(turn, fen_out);
+    printf("position %s\n", fen_out.c_str());
+    bool valid = true;
+    for (int32_t depth = 1; depth <= opt.depth; ++depth) {
+        const auto start = std::chrono::steady_clock::now();
+        const uint64_t nodes = opt.board ?
+            perft_board(board, turn, depth, opt.bulk) :
+            perft_bits(board.bits, turn, depth, opt.bulk);
+        const auto end = std::chrono::steady_clock::now();
+        const double secs = std::chrono::duration<double>(end - start).count();
+        printf("depth %2d  nodes %12llu  time %8.3fs  %10.0f nodes/sec",
+               depth,
+               (unsigned long long)nodes,
+               secs,
+               secs > 0.0 ? double(nodes) / secs : 0.0);
+        // check against the known counts for the starting position
+        if (!fen && depth < START_PERFT_DEPTH) {
+            const bool ok = (nodes == START_PERFT[depth]);
+            printf("  %s", ok ? "ok" : "MISMATCH");
+            valid &= ok;
+        }
+        printf("\n");
+    }
+    return valid;
+}
+
+void usage()
+{
+    printf("usage: checkers_perft [options] [fen ...]\n");
+    printf("  -d <depth>  search depth (default 8)\n");
+    printf("  -bulk       count moves at the last ply instead of making them\n");
+    printf("  -board      make moves with board_t::move\n");
+}
+
+} // namespace {}
+
+int main(int argc, char * args[])
+{
+    options_t opt = {8, false, false};
+    std::vector<const char *> fens;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(args[i], "-d") == 0 && i+1 < argc) {
+            opt.depth = atoi(args[++i]);
+        }
+        else if (strcmp(args[i], "-bulk") == 0) {
+            opt.bulk = true;
+        }
+        else if (strcmp(args[i], "-board") == 0) {
+            opt.board = true;
+        }
+        else if (args[i][0] == '-') {
+            usage();
+            return 1;
+        }
+        else {
+            fens.push_back(args[i]);
+        }
+    }
+    bool valid = true;
+    // perft from the starting position when no FEN is given
+    if (fens.empty()) {
+        valid &= run(nullptr, opt);
+    }
+    for (const char * fen : fens) {
+        valid &= run(fen, opt);
+    }
+    return valid ? 0 : 1;
+}
@@ -0,0 +1,96 @@
+#include <chrono>
+#include <cstdio>
+
+#include "checkers.h"
+
+// renderer that writes the event stream to a file, one line per event
+// prefixed with the milliseconds since init, so a game can be animated
+// later or somewhere else:
+//
+//   <ms> pieces <board_t::serialize>
+//   <ms> move <x0> <y0> <x1> <y1>
+//   <ms> capture <x> <y>
+//   <ms> crown <x> <y>
+struct record_render_t : public render_t
+{
+protected:
+    typedef std::chrono::steady_clock steady_clock_t;
+
+    std::string path;
+    FILE * file;
+    steady_clock_t::time_point start;
+    std::string layout;
+
+    long long now() const
+    {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(
+            steady_clock_t::now() - start).count();
+    }
+
+public:
+    record_render_t(const char * p)
+        : path(p)
+        , file(nullptr)
+    {
+    }
+
+    virtual ~record_render_t()
+    {
+        if (file) {
+            fclose(file);
+        }
+    }
+
+    virtual bool init()
+    {
+        file = fopen(path.c_str(), "w");
+        if (!file) {
+            log(LOG_ERROR, "unable to open '%s' to record events", path.c_str());
+            return false;
+        }
+        start = steady_clock_t::now();
+        return true;
+    }
+
+    virtual bool tick()
+    {
+        return file != nullptr;
+    }
+
+    virtual bool push_event(const event_t & event)
+    {
+        if (!file) {
+            return false;
+        }
+        const pos_t & a = event.pos[0];
+        const pos_t & b = event.pos[1];
+        switch (event.type) {
+        case (event_t::MOVE):
+            fprintf(file, "%lld move %d %d %d %d\n", now(), a.x, a.y, b.x, b.y);
+            break;
+        case (event_t::CAPTURE):
+            fprintf(file, "%lld capture %d %d\n", now(), a.x, a.y);
+            break;
+        case (event_t::CROWN):
+            fprintf(file, "%lld crown %d %d\n", now(), a.x, a.y);
+            break;
+        default:
+            break;
+        }
+        return true;
+    }
+
+    virtual bool set_pieces(const board_t & board)
+    {
+        if (!file || !board.serialize(layout)) {
+            return false;
+        }
+        fprintf(file, "%lld pieces %s\n", now(), layout.c_str());
+        return true;
+    }
+};
+
+render_t * new_record_render(const char * path)
+{
+    return new record_render_t(path);
+}
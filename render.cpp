@@ -1,82 +1,326 @@
 #include <SDL/SDL.h>
-#include <map>
-#include <thread>
+#include <algorithm>
+#include <cmath>
+#include <memory>
 #include <mutex>
+#include <vector>
 
 #include "checkers.h"
 
-struct sdl_render_t : public render_t {
-protected:
+namespace {
+
+// size of one board in unscaled pixels
+const int WIDTH = 154;
+const int HEIGHT = 91;
+const int TICK_INTERVAL = 1000/25;
+
+// gap between the boards a spectator tiles together
+const int TILE_GAP = 2;
+const uint32_t BACKGROUND = 0x101010;
+
+// images shared by every board drawn to a surface
+struct art_t
+{
+    SDL_Surface * board;
+    SDL_Surface * sprites;
+
+    art_t()
+        : board(nullptr)
+        , sprites(nullptr)
+    {
+    }
+
+    ~art_t()
+    {
+        if (board) {
+            SDL_FreeSurface(board);
+        }
+        if (sprites) {
+            SDL_FreeSurface(sprites);
+        }
+    }
+
+    // load the art, storing the board in the format it is drawn to
+    bool load(SDL_PixelFormat * format)
+    {
+        board = SDL_LoadBMP("art/board.bmp");
+        sprites = SDL_LoadBMP("art/sprites.bmp");
+        // check all gfx have loaded
+        if (!board||!sprites) {
+            log(LOG_ERROR, "unable to load art assets");
+            return false;
+        }
+        // the board covers the whole area it is drawn to, so store it in
+        // the same format to make that blit a plain copy
+        if (board->w != WIDTH || board->h != HEIGHT) {
+            log(LOG_ERROR, "board art must be %dx%d", WIDTH, HEIGHT);
+            return false;
+        }
+        SDL_Surface * converted = SDL_ConvertSurface(board, format, SDL_SWSURFACE);
+        if (!converted) {
+            log(LOG_ERROR, "unable to convert board art");
+            return false;
+        }
+        SDL_FreeSurface(board);
+        board = converted;
+        // set transparency for the sprites
+        SDL_SetColorKey(sprites, SDL_SRCCOLORKEY, 0xff00ff);
+        return true;
+    }
+};
+
+bool is_empty(const SDL_Rect & r)
+{
+    return r.w == 0 || r.h == 0;
+}
+
+// grow a rect to also cover another
+void merge(SDL_Rect & into, const SDL_Rect & r)
+{
+    if (is_empty(r)) {
+        return;
+    }
+    if (is_empty(into)) {
+        into = r;
+        return;
+    }
+    const int x0 = std::min<int>(into.x, r.x);
+    const int y0 = std::min<int>(into.y, r.y);
+    const int x1 = std::max<int>(into.x + into.w, r.x + r.w);
+    const int y1 = std::max<int>(into.y + into.h, r.y + r.h);
+    into = SDL_Rect{Sint16(x0), Sint16(y0), Uint16(x1 - x0), Uint16(y1 - y0)};
+}
+
+bool overlaps(const SDL_Rect & a, const SDL_Rect & b)
+{
+    return a.x < b.x + b.w && b.x < a.x + a.w &&
+           a.y < b.y + b.h && b.y < a.y + a.h;
+}
+
+// shrink a rect to fit inside one board
+SDL_Rect clip_to_board(const SDL_Rect & r)
+{
+    const int x0 = std::max<int>(r.x, 0);
+    const int y0 = std::max<int>(r.y, 0);
+    const int x1 = std::min<int>(r.x + r.w, WIDTH);
+    const int y1 = std::min<int>(r.y + r.h, HEIGHT);
+    if (x1 <= x0 || y1 <= y0) {
+        return SDL_Rect{0, 0, 0, 0};
+    }
+    return SDL_Rect{Sint16(x0), Sint16(y0), Uint16(x1 - x0), Uint16(y1 - y0)};
+}
+
+// one animated board, drawn into a WIDTH x HEIGHT area of a surface. it
+// remembers which part of that area has changed so a frame only redraws
+// the pieces the current event touched, and nothing at all when idle.
+struct board_view_t
+{
+    board_view_t()
+        : event(event_t {event_t::NONE})
+        , delta(0.f)
+        , active_piece(-1)
+        , resync(false)
+    {
+        for (piece_t & p : pieces) {
+            p = piece_t{WHITE, CAPTURED, pos_t{-1, -1}};
+        }
+        for (bool & vis : visible) {
+            vis = true;
+        }
+        // the board itself needs drawing
+        dirty = SDL_Rect{0, 0, WIDTH, HEIGHT};
+    }
+
+    // start again from a new set of pieces, which takes effect once the
+    // events queued before it have played out (producer only)
+    bool set_pieces(const board_t & board)
+    {
+        // a NONE event marks where the snapshot belongs in the stream
+        if (events.room() == 0 || !snapshots.push(board.piece)) {
+            return false;
+        }
+        return events.push(event_t{event_t::NONE});
+    }
+
+    // queue an event to be animated (producer only)
+    void push_event(const event_t & e)
+    {
+        resync = resync || !events.push(e);
+    }
+
+    // queue every event of one move, or if they will not fit, jump
+    // straight to the board they lead to (producer only)
+    void push_events(const event_list_t & list, const board_t & board)
+    {
+        if (!resync && events.push(list.begin(), list.size())) {
+            return;
+        }
+        resync = !set_pieces(board);
+    }
+
+    // redraw everything next frame
+    void touch_all()
+    {
+        dirty = SDL_Rect{0, 0, WIDTH, HEIGHT};
+    }
+
+    // advance the animation by one frame
+    void tick()
+    {
+        if (event.type == event_t::NONE) {
+            // the next event starts animating on the following frame
+            handle_event_none();
+            return;
+        }
+        // the active piece must be redrawn where it was and where it is
+        touch(active_piece);
+        switch (event.type) {
+        case (event_t::MOVE):
+            handle_event_move();
+            break;
+        case (event_t::CAPTURE):
+            handle_event_capture();
+            break;
+        case (event_t::CROWN):
+            handle_event_crown();
+            break;
+        default:
+            break;
+        }
+        touch(active_piece);
+    }
 
+    // draw the changed area with the board placed at (x, y) of a surface,
+    // returns false if nothing changed, otherwise the area drawn
+    bool draw(SDL_Surface * target,
+              const art_t & art,
+              Sint16 x,
+              Sint16 y,
+              SDL_Rect & drawn)
+    {
+        const SDL_Rect area = clip_to_board(dirty);
+        dirty = SDL_Rect{0, 0, 0, 0};
+        if (is_empty(area)) {
+            return false;
+        }
+        drawn = SDL_Rect{Sint16(x + area.x), Sint16(y + area.y), area.w, area.h};
+        SDL_Rect clip = drawn;
+        SDL_SetClipRect(target, &clip);
+        // repaint the board under the changed area
+        SDL_Rect src = area;
+        SDL_Rect dst = drawn;
+        SDL_BlitSurface(art.board, &src, target, &dst);
+        // then every piece that overlaps it
+        for (size_t i = 0; i<pieces.size(); ++i) {
+            if (overlaps(bounds(i), area)) {
+                draw_shadow(target, art, x, y, i);
+            }
+        }
+        for (size_t i = 0; i<pieces.size(); ++i) {
+            if (i!=active_piece && overlaps(bounds(i), area)) {
+                draw_piece(target, art, x, y, i);
+            }
+        }
+        if (active_piece!=size_t(-1)) {
+            draw_piece(target, art, x, y, active_piece);
+        }
+        SDL_SetClipRect(target, nullptr);
+        return true;
+    }
+
+protected:
     struct vec3f_t {
         float x, y, z;
     };
 
-    static const int WIDTH = 154;
-    static const int HEIGHT = 91;
-    static const int TICK_INTERVAL = 1000/25;
-
-    SDL_Surface * screen;
-    SDL_Surface * sub_target;
-    SDL_Surface * bmp_board;
-    SDL_Surface * bmp_sprites;
-
     std::array<piece_t, 12*2> pieces;
     std::array<vec3f_t, 12*2> pos;
     std::array<bool,    12*2> visible;
-    std::deque<event_t> event_queue;
-
-    bool active;
-    int32_t ticks_next;
-    std::mutex mux;
 
     // current event being processed
     event_t event;
     float delta;
     size_t active_piece;
 
-    bool present()
-    {
-        const uint32_t * src = (const uint32_t*)sub_target->pixels;
-        uint32_t * dst = (uint32_t*)screen->pixels;
-        const uint32_t dp = (screen->pitch/4);
-        for (uint32_t y = 0; y<HEIGHT; ++y) {
-            for (uint32_t x = 0; x<WIDTH; ++x) {
-                const uint32_t c = src[x];
-                for (int i = 0; i<4; i++) {
-                    dst[(dp*i)+(x*4)+0] = c;
-                    dst[(dp*i)+(x*4)+1] = c;
-                    dst[(dp*i)+(x*4)+2] = c;
-                    dst[(dp*i)+(x*4)+3] = c;
-                }
-            }
-            src += (sub_target->pitch/4);
-            dst += (screen->pitch/4) * 4;
+    // area that has changed since the last draw
+    SDL_Rect dirty;
+
+    // filled by the game thread, drained by the render thread
+    spsc_ring_t<event_t, 256> events;
+    spsc_ring_t<std::array<piece_t, 12*2>, 4> snapshots;
+    // set by the game thread after dropping events, until a snapshot
+    // gets through to bring the view back in step
+    bool resync;
+
+    // replace every piece with the next queued snapshot
+    void take_snapshot()
+    {
+        if (!snapshots.pop(pieces)) {
+            return;
         }
-        SDL_Flip(screen);
-        SDL_FillRect(sub_target, nullptr, 0x101010);
-        return true;
+        for (size_t i = 0; i<pieces.size(); ++i) {
+            piece_t & p = pieces[i];
+            lerp_piece(int32_t(i), p.pos, p.pos, 0.f);
+            visible[i] = true;
+        }
+        touch_all();
     }
 
-    bool poll_sdl_events()
+    // where the lower sprite of a piece is drawn
+    SDL_Rect piece_rect(size_t index) const
     {
-        SDL_Event event;
-        while (SDL_PollEvent(&event)) {
-            active &= (event.type!=SDL_QUIT);
-            if (event.type==SDL_KEYDOWN) {
-                if (event.key.keysym.sym == SDLK_ESCAPE) {
-                    active = false;
-                }
-            }
+        const float lx = pos[index].x;
+        const float ly = pos[index].y;
+        const float lz = pos[index].z;
+        // transform into 2D screen space
+        const int32_t tx = int32_t(5.f +lx*12.f+ly*7.f);
+        const int32_t ty = int32_t(30.f-lx *4.f+ly*7.f - lz * 8.f);
+        return SDL_Rect{int16_t(tx), int16_t(ty), 16, 8};
+    }
+
+    // where the shadow of a piece is drawn
+    SDL_Rect shadow_rect(size_t index) const
+    {
+        const float lx = pos[index].x;
+        const float ly = pos[index].y;
+        const float lz = pos[index].z;
+        // transform into 2D screen space
+        const int32_t tx = int32_t(5.f +lx*12.f+ly*7.f + lz * 2.f);
+        const int32_t ty = int32_t(30.f-lx *4.f+ly*7.f);
+        return SDL_Rect{
+            int16_t(tx + (pieces[index].type==CROWNED ? 2 : 1)),
+            int16_t(ty),
+            16,
+            8
+        };
+    }
+
+    // every pixel a piece, its crown and its shadow may cover
+    SDL_Rect bounds(size_t index) const
+    {
+        SDL_Rect r = piece_rect(index);
+        // room for a crown on top
+        r.y -= 3;
+        r.h += 3;
+        SDL_Rect shadow = shadow_rect(index);
+        // the shadow shifts by a pixel when crowned
+        shadow.w += 1;
+        merge(r, shadow);
+        return r;
+    }
+
+    void touch(size_t index)
+    {
+        if (index != size_t(-1)) {
+            merge(dirty, bounds(index));
         }
-        return true;
     }
 
     bool lerp_piece(int index,
                     pos_t from,
                     pos_t to,
                     float lerp) {
-        
+
         // lerp between positions
         float lx = float(to.x)*lerp+float(from.x)*(1.f-lerp);
         float ly = float(to.y)*lerp+float(from.y)*(1.f-lerp);
@@ -91,44 +335,38 @@ protected:
         pos[index] = vec3f_t{lx, ly, lz};
         return true;
     }
-    
-    bool draw_shadow(int index)
+
+    bool draw_shadow(SDL_Surface * target,
+                     const art_t & art,
+                     Sint16 x,
+                     Sint16 y,
+                     size_t index)
     {
-        // grab piece 3D position
-        const float lx = pos[index].x;
-        const float ly = pos[index].y;
-        const float lz = pos[index].z;
         // grab some visible state information
         const piece_state_e state = pieces[index].type;
         // captured peices are not drawn
         if (state==piece_state_e::CAPTURED || !visible[index]) {
             return true;
         }
-        // transform into 2D screen space
-        const int32_t tx = int32_t(5.f +lx*12.f+ly*7.f + lz * 2.f);
-        const int32_t ty = int32_t(30.f-lx *4.f+ly*7.f);
         // sprite sheet location
         SDL_Rect src = SDL_Rect {
             32, 0, 16, 8
         };
         // screen space location
-        SDL_Rect dst = SDL_Rect {
-            int16_t(tx + (state==CROWNED ? 2 : 1)),
-            int16_t(ty),
-            16,
-            8
-        };
+        SDL_Rect dst = shadow_rect(index);
+        dst.x += x;
+        dst.y += y;
         // blit bottom layer
-        SDL_BlitSurface(bmp_sprites, &src, sub_target, &dst);
+        SDL_BlitSurface(art.sprites, &src, target, &dst);
         return true;
     }
 
-    bool draw_piece(int index)
+    bool draw_piece(SDL_Surface * target,
+                    const art_t & art,
+                    Sint16 x,
+                    Sint16 y,
+                    size_t index)
     {
-        // grab piece 3D position
-        const float lx = pos[index].x;
-        const float ly = pos[index].y;
-        const float lz = pos[index].z;
         // grab some visible state information
         const colour_e clr = pieces[index].owner;
         const piece_state_e state = pieces[index].type;
@@ -136,39 +374,22 @@ protected:
         if (state==piece_state_e::CAPTURED || !visible[index]) {
             return true;
         }
-        // transform into 2D screen space
-        const int32_t tx = int32_t(5.f +lx*12.f+ly*7.f);
-        const int32_t ty = int32_t(30.f-lx *4.f+ly*7.f - lz * 8.f);
         // sprite sheet location
         SDL_Rect src = SDL_Rect {
             Sint16(clr==WHITE ? 0 : 16), 0, 16, 8
         };
         // screen space location
-        SDL_Rect dst = SDL_Rect {
-            int16_t(tx), int16_t(ty), 16, 8
-        };
+        SDL_Rect dst = piece_rect(index);
+        dst.x += x;
+        dst.y += y;
+        // blit calls clip dst so keep a copy for the top layer
+        SDL_Rect top = dst;
         // blit bottom layer
-        SDL_BlitSurface(bmp_sprites, &src, sub_target, &dst);
+        SDL_BlitSurface(art.sprites, &src, target, &dst);
         // blit top layer
         if (state==piece_state_e::CROWNED) {
-            dst.y -= 3;
-            SDL_BlitSurface(bmp_sprites, &src, sub_target, &dst);
-        }
-        return true;
-    }
-    
-    bool draw_pieces()
-    {
-        for (size_t i = 0; i<pieces.size(); ++i) {
-            draw_shadow(int32_t(i));
-        }
-        for (size_t i = 0; i<pieces.size(); ++i) {
-            if (i!=active_piece) {
-                draw_piece(int32_t(i));
-            }
-        }
-        if (active_piece!=-1) {
-            draw_piece(active_piece);
+            top.y -= 3;
+            SDL_BlitSurface(art.sprites, &src, target, &top);
         }
         return true;
     }
@@ -177,7 +398,11 @@ protected:
     {
         delta = 0.f;
         active_piece = -1;
-        if (!pop_event(event)) {
+        if (!events.pop(event)) {
+            return true;
+        }
+        if (event.type == event_t::NONE) {
+            take_snapshot();
             return true;
         }
         for (size_t i = 0; i<pieces.size(); ++i) {
@@ -190,6 +415,7 @@ protected:
         }
         // unable to find the piece referenced by event
         assert(!"Unable to find piece in event");
+        event.type = event_t::NONE;
         return false;
     }
 
@@ -262,107 +488,132 @@ protected:
         }
         return true;
     }
+};
+
+// handle window events, returns false once the user asks to quit
+bool poll_sdl_events(bool & exposed)
+{
+    bool active = true;
+    SDL_Event event;
+    while (SDL_PollEvent(&event)) {
+        active &= (event.type!=SDL_QUIT);
+        if (event.type==SDL_KEYDOWN) {
+            if (event.key.keysym.sym == SDLK_ESCAPE) {
+                active = false;
+            }
+        }
+        exposed |= (event.type==SDL_VIDEOEXPOSE);
+    }
+    return active;
+}
+
+// check if it is time for the next frame
+bool next_frame(int32_t & ticks_next)
+{
+    // wait for our timeslice
+    int32_t delta = SDL_GetTicks()-ticks_next;
+    if (delta < 0) {
+        return false;
+    }
+    if (delta>500) {
+        ticks_next += delta;
+    }
+    ticks_next += TICK_INTERVAL;
+    return true;
+}
+
+} // namespace {}
+
+struct sdl_render_t : public render_t {
+protected:
+
+    SDL_Surface * screen;
+    SDL_Surface * sub_target;
+    art_t art;
+    board_view_t view;
+
+    bool active;
+    int32_t ticks_next;
+
+    // 4x upscale for this cpu
+    upscale_t::fn_t upscale;
+
+    // scale part of the sub target up to the screen and show it
+    bool present(const SDL_Rect & area)
+    {
+        const size_t src_pitch = sub_target->pitch/4;
+        const size_t dst_pitch = screen->pitch/4;
+        const uint32_t * src = (const uint32_t*)sub_target->pixels +
+                               area.y * src_pitch + area.x;
+        uint32_t * dst = (uint32_t*)screen->pixels +
+                         area.y * 4 * dst_pitch + area.x * 4;
+        upscale(src, src_pitch, dst, dst_pitch, area.w, area.h);
+        SDL_UpdateRect(screen, area.x*4, area.y*4, area.w*4, area.h*4);
+        return true;
+    }
 
     bool game_tick()
     {
-        // draw the checkers board
-        SDL_BlitSurface(bmp_board, nullptr, sub_target, nullptr);
         // dispatch activity based on event from game
-        switch (event.type) {
-        case (event_t::NONE):
-            handle_event_none();
-            break;
-        case (event_t::MOVE):
-            handle_event_move();
-            break;
-        case (event_t::CAPTURE):
-            handle_event_capture();
-            break;
-        case (event_t::CROWN):
-            handle_event_crown();
-            break;
+        view.tick();
+        // draw only what changed, idle frames draw nothing
+        SDL_Rect area;
+        if (!view.draw(sub_target, art, 0, 0, area)) {
+            return true;
         }
-        // draw the board pieces
-        draw_pieces();
         // flush draw surface to the screen
-        if (!present()) {
+        if (!present(area)) {
             assert(!"Error while trying to present");
             return false;
         }
         return true;
     }
 
-    bool pop_event(event_t & out)
-    {
-        std::lock_guard<std::mutex> guard(mux);
-        if (event_queue.empty()) {
-            return false;
-        }
-        else {
-            out = event_queue.front();
-            event_queue.pop_front();
-            return true;
-        }
-    }
-
 public:
 
     sdl_render_t()
         : screen(nullptr)
         , sub_target(nullptr)
-        , bmp_board(nullptr)
-        , bmp_sprites(nullptr)
         , active(false)
-        , event(event_t {event_t::NONE})
-        , delta(0.f)
-        , active_piece(-1)
+        , upscale(upscale_t::best())
     {
-        for (bool & vis:visible) {
-            vis = true;
-        }
     }
 
     virtual bool init()
     {
         // init the SDL library
         if (SDL_Init(SDL_INIT_VIDEO)) {
-            log("unable to initalize SDL video");
+            log(LOG_ERROR, "unable to initalize SDL video");
             return false;
         }
         // open and SDL window at 4x scale
         screen = SDL_SetVideoMode(WIDTH*4, HEIGHT*4, 32, 0);
         if (!screen) {
-            log("unable to create main surface");
+            log(LOG_ERROR, "unable to create main surface");
             return false;
         }
         // create subtarget
         sub_target = SDL_CreateRGBSurface(
-            SDL_SWSURFACE, 
-            WIDTH, 
-            HEIGHT, 
-            32, 
-            0xff<<16, 
-            0xff<<8, 
-            0xff<<0, 
+            SDL_SWSURFACE,
+            WIDTH,
+            HEIGHT,
+            32,
+            0xff<<16,
+            0xff<<8,
+            0xff<<0,
             0xff<<24);
         if (!sub_target) {
-            log("unable to create subtarget surface");
+            log(LOG_ERROR, "unable to create subtarget surface");
             return false;
         }
         // load src graphics
-        bmp_board = SDL_LoadBMP("art/board.bmp");
-        bmp_sprites = SDL_LoadBMP("art/sprites.bmp");
-        // check all gfx have loaded
-        if (!bmp_board||!bmp_sprites) {
-            log("unable to load art assets");
+        if (!art.load(sub_target->format)) {
             return false;
         }
-        // set transparency for the sprites
-        SDL_SetColorKey(bmp_sprites, SDL_SRCCOLORKEY, 0xff00ff);
         // renderer is active
         active = true;
         ticks_next = SDL_GetTicks();
-        // 
+        //
         SDL_WM_SetCaption("Checkers", nullptr);
         return true;
     }
@@ -374,16 +625,13 @@ public:
             return false;
         }
         // handle any events that come from SDL
-        if (!poll_sdl_events()) {
-            return false;
+        bool exposed = false;
+        active = poll_sdl_events(exposed);
+        if (exposed) {
+            // the screen still holds the last frame
+            SDL_UpdateRect(screen, 0, 0, 0, 0);
         }
-        // wait for our timeslice
-        int32_t delta = SDL_GetTicks()-ticks_next;
-        if (delta >= 0) {
-            if (delta>500) {
-                ticks_next += delta;
-            }
-            ticks_next += TICK_INTERVAL;
+        if (next_frame(ticks_next)) {
             game_tick();
         }
         return active;
@@ -391,22 +639,183 @@ public:
 
     virtual bool push_event(const event_t & event)
     {
-        std::lock_guard<std::mutex> guard(mux);
-        event_queue.push_back(event);
+        view.push_event(event);
         return true;
     }
 
-    virtual bool set_pieces(const board_t & board)
+    virtual bool push_events(const event_list_t & events,
+                             const board_t & board)
     {
-        pieces = board.piece;
-        for (size_t i = 0; i<pieces.size(); ++i) {
-            piece_t & p = pieces[i];
-            lerp_piece(int32_t(i), p.pos, p.pos, 0.f);
-        }
+        view.push_events(events, board);
         return true;
     }
+
+    virtual bool set_pieces(const board_t & board)
+    {
+        return view.set_pieces(board);
+    }
 };
 
 render_t * new_sdl_render() {
     return new sdl_render_t;
 }
+
+// tiles many games into one window, each game drawing into its own tile
+struct sdl_spectator_t : public render_pool_t {
+protected:
+
+    // a renderer handed out for one game
+    struct tile_t : public render_t
+    {
+        board_view_t view;
+        // top left of the tile on the screen
+        Sint16 x, y;
+        bool in_use;
+
+        virtual bool init()
+        {
+            return true;
+        }
+
+        // the spectator draws every tile in its own tick
+        virtual bool tick()
+        {
+            return true;
+        }
+
+        virtual bool push_event(const event_t & event)
+        {
+            view.push_event(event);
+            return true;
+        }
+
+        virtual bool push_events(const event_list_t & events,
+                                 const board_t & board)
+        {
+            view.push_events(events, board);
+            return true;
+        }
+
+        virtual bool set_pieces(const board_t & board)
+        {
+            return view.set_pieces(board);
+        }
+    };
+
+    SDL_Surface * screen;
+    art_t art;
+    std::vector<std::unique_ptr<tile_t>> tiles;
+    // guards tile ownership
+    std::mutex mux;
+    // areas drawn this frame
+    std::vector<SDL_Rect> drawn;
+
+    bool active;
+    int32_t ticks_next;
+    int32_t columns, rows;
+
+public:
+
+    sdl_spectator_t(int32_t boards)
+        : screen(nullptr)
+        , active(false)
+        , ticks_next(0)
+    {
+        boards = std::max(1, boards);
+        // as close to square as the board count allows
+        columns = int32_t(std::ceil(std::sqrt(double(boards))));
+        rows = (boards + columns - 1) / columns;
+        for (int32_t i = 0; i < boards; ++i) {
+            tile_t * t = new tile_t;
+            t->x = Sint16(TILE_GAP + (i % columns) * (WIDTH + TILE_GAP));
+            t->y = Sint16(TILE_GAP + (i / columns) * (HEIGHT + TILE_GAP));
+            t->in_use = false;
+            tiles.emplace_back(t);
+        }
+    }
+
+    virtual bool init()
+    {
+        if (SDL_Init(SDL_INIT_VIDEO)) {
+            log(LOG_ERROR, "unable to initalize SDL video");
+            return false;
+        }
+        // boards are drawn unscaled so many fit on one screen
+        screen = SDL_SetVideoMode(TILE_GAP + columns * (WIDTH + TILE_GAP),
+                                  TILE_GAP + rows * (HEIGHT + TILE_GAP),
+                                  32,
+                                  SDL_SWSURFACE);
+        if (!screen) {
+            log(LOG_ERROR, "unable to create main surface");
+            return false;
+        }
+        if (!art.load(screen->format)) {
+            return false;
+        }
+        SDL_FillRect(screen, nullptr, BACKGROUND);
+        SDL_UpdateRect(screen, 0, 0, 0, 0);
+        active = true;
+        ticks_next = SDL_GetTicks();
+        SDL_WM_SetCaption("Checkers spectator", nullptr);
+        return true;
+    }
+
+    virtual bool tick()
+    {
+        if (!screen || !active) {
+            return false;
+        }
+        bool exposed = false;
+        active = poll_sdl_events(exposed);
+        if (exposed) {
+            SDL_UpdateRect(screen, 0, 0, 0, 0);
+        }
+        if (!next_frame(ticks_next)) {
+            return active;
+        }
+        // idle tiles have nothing dirty and cost nothing to visit
+        drawn.clear();
+        for (auto & t : tiles) {
+            t->view.tick();
+            SDL_Rect area;
+            if (t->view.draw(screen, art, t->x, t->y, area)) {
+                drawn.push_back(area);
+            }
+        }
+        if (!drawn.empty()) {
+            SDL_UpdateRects(screen, int(drawn.size()), drawn.data());
+        }
+        return active;
+    }
+
+    virtual render_t * acquire()
+    {
+        std::lock_guard<std::mutex> guard(mux);
+        for (auto & t : tiles) {
+            if (!t->in_use) {
+                t->in_use = true;
+                return t.get();
+            }
+        }
+        return nullptr;
+    }
+
+    virtual void release(render_t * render)
+    {
+        std::lock_guard<std::mutex> guard(mux);
+        for (auto & t : tiles) {
+            if (t.get() == render) {
+                // clear the finished game off the tile
+                board_t empty;
+                empty.piece.fill(piece_t{WHITE, CAPTURED, pos_t{-1, -1}});
+                t->view.set_pieces(empty);
+                t->in_use = false;
+            }
+        }
+    }
+};
+
+render_pool_t * new_sdl_spectator(int32_t boards)
+{
+    return new sdl_spectator_t(boards);
+}
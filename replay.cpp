@@ -0,0 +1,129 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <vector>
+
+#include "checkers.h"
+
+namespace {
+
+struct stats_t
+{
+    uint64_t games;
+    uint64_t plies;
+    // games where the referee board and the bitboard disagreed
+    uint64_t diverged;
+    // decisive games whose result does not match the final position
+    uint64_t bad_results;
+};
+
+// play a game through board_t as the referee would, checking it stays
+// in step with the bitboard and its hash after every move
+bool replay(const pdn_game_t & game, stats_t & stats)
+{
+    board_t board;
+    if (!game.start.to_board(board)) {
+        return false;
+    }
+    bitboard_t bits = game.start;
+    colour_e turn = game.turn;
+    event_list_t events;
+    move_t move;
+    undo_t undo;
+    for (const bitmove_t & m : game.moves) {
+        m.to_move(move);
+        events.clear();
+        if (!board.make(move, turn, events, undo)) {
+            return false;
+        }
+        bits.apply(m, turn);
+        if (!(board.bits == bits) || board.hash != zobrist_t::hash(bits)) {
+            return false;
+        }
+        turn = (turn == WHITE) ? BLACK : WHITE;
+        ++stats.plies;
+    }
+    // a side left without moves has lost
+    move_list_t list;
+    if (game.result != pdn_game_t::UNKNOWN &&
+        bits.generate(turn, list) && list.size == 0) {
+        const pdn_game_t::result_e expect =
+            (turn == WHITE) ? pdn_game_t::BLACK_WIN : pdn_game_t::WHITE_WIN;
+        stats.bad_results += (game.result != expect) ? 1 : 0;
+    }
+    return true;
+}
+
+void usage()
+{
+    printf("usage: checkers_replay [options] <file.pdn ...>\n");
+    printf("  -o <file>   append every game read to another PDN file\n");
+}
+
+} // namespace {}
+
+int main(int argc, char * args[])
+{
+    const char * out = nullptr;
+    std::vector<const char *> files;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(args[i], "-o") == 0 && i+1 < argc) {
+            out = args[++i];
+        }
+        else if (args[i][0] == '-') {
+            usage();
+            return 1;
+        }
+        else {
+            files.push_back(args[i]);
+        }
+    }
+    if (files.empty()) {
+        usage();
+        return 1;
+    }
+    pdn_writer_t writer;
+    if (out && !writer.open(out)) {
+        printf("unable to open '%s'\n", out);
+        return 1;
+    }
+    stats_t stats = {0, 0, 0, 0};
+    uint64_t skipped = 0;
+    const auto start = std::chrono::steady_clock::now();
+    pdn_game_t game;
+    for (const char * file : files) {
+        pdn_reader_t reader;
+        if (!reader.open(file)) {
+            printf("unable to open '%s'\n", file);
+            return 1;
+        }
+        while (reader.next(game)) {
+            ++stats.games;
+            if (!replay(game, stats)) {
+                ++stats.diverged;
+            }
+            if (out) {
+                writer.write(game);
+            }
+        }
+        skipped += reader.skipped();
+    }
+    writer.close();
+    const auto end = std::chrono::steady_clock::now();
+    const double secs = std::chrono::duration<double>(end - start).count();
+    printf("games %llu  plies %llu  skipped %llu  time %.3fs  %.0f games/sec  %.0f plies/sec\n",
+           (unsigned long long)stats.games,
+           (unsigned long long)stats.plies,
+           (unsigned long long)skipped,
+           secs,
+           secs > 0.0 ? double(stats.games) / secs : 0.0,
+           secs > 0.0 ? double(stats.plies) / secs : 0.0);
+    if (stats.diverged || stats.bad_results) {
+        printf("diverged %llu  bad results %llu\n",
+               (unsigned long long)stats.diverged,
+               (unsigned long long)stats.bad_results);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,104 @@
+#include <cstdio>
+#include <thread>
+
+#include "checkers.h"
+
+namespace {
+
+typedef spsc_ring_t<uint32_t, 8> ring_t;
+
+bool failed = false;
+
+void check(bool ok, const char * what)
+{
+    if (!ok) {
+        printf("FAIL  %s\n", what);
+        failed = true;
+    }
+}
+
+// items come out in the order they went in, over many laps of the ring
+void test_wraparound()
+{
+    ring_t ring;
+    uint32_t next_in = 0, next_out = 0;
+    // an odd step keeps the ends moving to different slots every lap
+    for (int32_t lap = 0; lap < 100; ++lap) {
+        for (int32_t i = 0; i < 5; ++i) {
+            check(ring.push(next_in++), "push with room");
+        }
+        for (int32_t i = 0; i < 5; ++i) {
+            uint32_t v = ~0u;
+            check(ring.pop(v), "pop of a pushed item");
+            check(v == next_out++, "items leave in order");
+        }
+    }
+    uint32_t v;
+    check(ring.empty(), "drained ring is empty");
+    check(!ring.pop(v), "pop of an empty ring");
+}
+
+// a full ring refuses more, and a batch is taken whole or not at all
+void test_full()
+{
+    ring_t ring;
+    const uint32_t items[8] = {0, 1, 2, 3, 4, 5, 6, 7};
+    check(ring.room() == 8, "empty ring has room for all");
+    check(ring.empty(), "new ring is empty");
+    check(ring.push(items, 6), "batch that fits");
+    check(!ring.empty(), "ring with items is not empty");
+    check(ring.room() == 2, "room after a batch");
+    check(!ring.push(items, 3), "batch larger than the room");
+    check(ring.room() == 2, "refused batch leaves nothing behind");
+    check(ring.push(items + 6, 2), "batch that fills the ring");
+    check(ring.room() == 0, "full ring has no room");
+    check(!ring.push(items[0]), "push to a full ring");
+    uint32_t v = ~0u;
+    for (uint32_t i = 0; i < 8; ++i) {
+        check(ring.pop(v) && v == i, "full ring drains in order");
+    }
+    check(!ring.pop(v), "pop of a drained ring");
+    // the slots freed by popping can be used again
+    check(ring.push(items, 8), "refill after draining");
+    check(ring.room() == 0, "refilled ring is full");
+}
+
+// one thread pushing while another pops sees every item once, in order
+void test_threads()
+{
+    const uint32_t COUNT = 1000000;
+    static ring_t ring;
+    std::thread producer([]() {
+        for (uint32_t i = 0; i < COUNT;) {
+            if (ring.push(i)) {
+                ++i;
+            }
+            else {
+                std::this_thread::yield();
+            }
+        }
+    });
+    bool ordered = true;
+    for (uint32_t expect = 0; expect < COUNT;) {
+        uint32_t v;
+        if (ring.pop(v)) {
+            ordered &= (v == expect++);
+        }
+        else {
+            std::this_thread::yield();
+        }
+    }
+    producer.join();
+    check(ordered, "items cross threads in order");
+}
+
+} // namespace {}
+
+int main()
+{
+    test_wraparound();
+    test_full();
+    test_threads();
+    printf("spsc_ring_t: %s\n", failed ? "failed" : "ok");
+    return failed ? 1 : 0;
+}
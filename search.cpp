@@ -0,0 +1,634 @@
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <thread>
+
+#include "checkers.h"
+
+namespace {
+
+typedef std::chrono::steady_clock steady_clock_t;
+
+// bounds on the score of a position
+const int32_t INF = 32000;
+// score of a won position, less the ply at which it is won
+const int32_t WIN = 30000;
+// deepest ply the search can reach including capture extensions
+const int32_t MAX_PLY = 128;
+// score of a tablebase win, less the plies needed to reach it
+const int32_t TB_WIN = WIN - 2*MAX_PLY;
+// scores beyond this are wins at a known distance, found by the search or
+// read from the tablebase (at most MAX_PLY plies deep and 127 more)
+const int32_t WIN_BAND = TB_WIN - 2*MAX_PLY;
+// transposition table size used until told otherwise
+const size_t DEFAULT_HASH_MB = 16;
+// leaf batches are padded to a whole number of vector kernel lanes
+const size_t EVAL_LANES = 8;
+
+// win scores are stored relative to the node rather than the root
+int32_t to_tt(int32_t score, int32_t ply)
+{
+    if (score > WIN_BAND) {
+        return score + ply;
+    }
+    if (score < -WIN_BAND) {
+        return score - ply;
+    }
+    return score;
+}
+
+int32_t from_tt(int32_t score, int32_t ply)
+{
+    if (score > WIN_BAND) {
+        return score - ply;
+    }
+    if (score < -WIN_BAND) {
+        return score + ply;
+    }
+    return score;
+}
+
+colour_e opponent(colour_e c)
+{
+    return c == WHITE ? BLACK : WHITE;
+}
+
+// search state owned by one thread
+struct worker_t
+{
+    // nodes visited during this search
+    uint64_t nodes;
+    // time the search must finish by
+    steady_clock_t::time_point deadline;
+    bool timed;
+    // set when this worker has stopped searching
+    bool aborted;
+    // shared signal for all workers to stop
+    std::atomic<bool> * stop;
+    // quiet moves that caused a cutoff at each ply
+    std::array<std::array<bitmove_t, 2>, MAX_PLY> killer;
+    // cutoff history indexed by [from][to]
+    int32_t history[32][32];
+    // results of earlier searches, shared by all workers
+    tt_t * tt;
+    // endgame tablebase if one is available
+    const tablebase_t * tb;
+    // evaluation network if one is loaded
+    const nnue_t * net;
+    // network accumulator for the position at each ply
+    std::array<nnue_t::accumulator_t, MAX_PLY> acc;
+    // widest static evaluation kernel this cpu has
+    eval_t::batch_fn_t batch;
+    // static scores of the children of the node at each ply, computed
+    // together before they are searched
+    std::array<std::array<int32_t, move_list_t::MAX_MOVES>, MAX_PLY> leaf;
+    std::array<bitboard_t, move_list_t::MAX_MOVES> leaf_pos;
+    std::array<colour_e, move_list_t::MAX_MOVES> leaf_turn;
+    // score from the batch for the next search call to use at a leaf
+    const int32_t * known_eval;
+    // principal variation being built at each ply
+    std::array<std::array<bitmove_t, MAX_PLY>, MAX_PLY> pv;
+    std::array<int32_t, MAX_PLY> pv_length;
+    // principal variation from the last completed iteration
+    std::array<bitmove_t, MAX_PLY> prev_pv;
+    int32_t prev_pv_length;
+
+    worker_t(tt_t * t, std::atomic<bool> * s)
+        : nodes(0)
+        , timed(false)
+        , aborted(false)
+        , stop(s)
+        , tt(t)
+        , tb(nullptr)
+        , net(nullptr)
+        , batch(eval_t::best())
+        , known_eval(nullptr)
+        , prev_pv_length(0)
+    {
+        memset(&killer, 0, sizeof(killer));
+        memset(history, 0, sizeof(history));
+    }
+
+    bool check_time()
+    {
+        if (stop->load(std::memory_order_relaxed)) {
+            aborted = true;
+        }
+        else if (timed && steady_clock_t::now() >= deadline) {
+            // out of time so bring every worker to a halt
+            stop->store(true, std::memory_order_relaxed);
+            aborted = true;
+        }
+        return !aborted;
+    }
+
+    // assign an ordering score to each move in the list
+    void score_moves(const move_list_t & list,
+                     const bitmove_t * first,
+                     int32_t ply,
+                     int32_t * score)
+    {
+        for (size_t i = 0; i < list.size; ++i) {
+            const bitmove_t & m = list.move[i];
+            if (first && m == *first) {
+                score[i] = 1 << 30;
+            }
+            else if (m.taken) {
+                // take as many pieces as possible first
+                score[i] = (1 << 24) + bitboard_t::count(m.taken);
+            }
+            else if (m == killer[ply][0]) {
+                score[i] = (1 << 22);
+            }
+            else if (m == killer[ply][1]) {
+                score[i] = (1 << 21);
+            }
+            else {
+                score[i] = history[m.from][m.to()];
+            }
+        }
+    }
+
+    // swap the best remaining move into position i, and its leaf score
+    // along with it if there is one
+    void pick_move(move_list_t & list, int32_t * score, int32_t * scores, size_t i)
+    {
+        size_t best = i;
+        for (size_t j = i+1; j < list.size; ++j) {
+            if (score[j] > score[best]) {
+                best = j;
+            }
+        }
+        if (best != i) {
+            std::swap(list.move[i], list.move[best]);
+            std::swap(score[i], score[best]);
+            if (scores) {
+                std::swap(scores[i], scores[best]);
+            }
+        }
+    }
+
+    // score the children of a node from begin on in one batch, for the
+    // ones that turn out to be leaves
+    void evaluate_children(const bitboard_t & pos,
+                           colour_e turn,
+                           const move_list_t & list,
+                           size_t begin,
+                           int32_t * out)
+    {
+        const colour_e other = opponent(turn);
+        size_t count = 0;
+        for (size_t i = begin; i < list.size; ++i, ++count) {
+            leaf_pos[count] = pos;
+            leaf_pos[count].apply(list.move[i], turn);
+            leaf_turn[count] = other;
+        }
+        // repeat the last child to fill the final vector
+        for (const size_t last = count - 1; count % EVAL_LANES; ++count) {
+            leaf_pos[count] = leaf_pos[last];
+            leaf_turn[count] = other;
+        }
+        batch(leaf_pos.data(), leaf_turn.data(), count, out + begin);
+    }
+
+    // extend the principal variation at a ply with a new best move
+    void update_pv(const bitmove_t & m, int32_t ply)
+    {
+        pv[ply][ply] = m;
+        for (int32_t i = ply+1; i < pv_length[ply+1]; ++i) {
+            pv[ply][i] = pv[ply+1][i];
+        }
+        pv_length[ply] = std::max(pv_length[ply+1], ply+1);
+    }
+
+    // record a quiet move that caused a beta cutoff
+    void update_cutoff(const bitmove_t & m, int32_t depth, int32_t ply)
+    {
+        if (m.taken) {
+            return;
+        }
+        if (!(m == killer[ply][0])) {
+            killer[ply][1] = killer[ply][0];
+            killer[ply][0] = m;
+        }
+        int32_t & h = history[m.from][m.to()];
+        h += depth * depth;
+        // keep history below the killer move scores
+        if (h > (1 << 20)) {
+            for (auto & row : history) {
+                for (int32_t & v : row) {
+                    v /= 2;
+                }
+            }
+        }
+    }
+
+    int32_t search(const bitboard_t & pos,
+                   uint64_t key,
+                   colour_e turn,
+                   int32_t depth,
+                   int32_t ply,
+                   int32_t alpha,
+                   int32_t beta)
+    {
+        // a score our parent computed for us is only good for this call
+        const int32_t * known = known_eval;
+        known_eval = nullptr;
+        // periodically check if we are out of time
+        if ((++nodes & 1023) == 0 && !check_time()) {
+            return 0;
+        }
+        if (aborted) {
+            return 0;
+        }
+        pv_length[ply] = ply;
+        move_list_t list;
+        pos.generate(turn, list);
+        // a side that cant move has lost
+        if (list.size == 0) {
+            return -(WIN - ply);
+        }
+        // endgames are answered exactly by the tablebase
+        if (tb && bitboard_t::count(pos.white | pos.black) <= tb->pieces()) {
+            tablebase_t::result_e result;
+            int32_t distance;
+            if (tb->probe(pos, turn, result, distance)) {
+                switch (result) {
+                case (tablebase_t::WIN):
+                    return TB_WIN - ply - distance;
+                case (tablebase_t::LOSS):
+                    return -(TB_WIN - ply - distance);
+                default:
+                    return 0;
+                }
+            }
+        }
+        // captures are searched out beyond the horizon
+        const bool capture = list.move[0].taken != 0;
+        if ((depth <= 0 && !capture) || ply >= MAX_PLY-1) {
+            if (known) {
+                return *known;
+            }
+            return net ? net->evaluate(acc[ply], turn) : eval_t::evaluate(pos, turn);
+        }
+        // forced replies do not use up depth
+        if (list.size == 1) {
+            ++depth;
+        }
+        // check for a stored result from an earlier search
+        const bool pv_node = (beta - alpha) > 1;
+        tt_t::hit_t hit;
+        const bool have_hit = tt->probe(key, hit);
+        if (have_hit && !pv_node && hit.depth >= std::max(depth, 0)) {
+            const int32_t value = from_tt(hit.score, ply);
+            if (hit.bound == tt_t::EXACT ||
+                (hit.bound == tt_t::LOWER && value >= beta) ||
+                (hit.bound == tt_t::UPPER && value <= alpha)) {
+                return value;
+            }
+        }
+        // try the stored best move, or the last principal variation, first
+        const bitmove_t * first = (ply < prev_pv_length) ? &prev_pv[ply] : nullptr;
+        if (have_hit && hit.from != hit.to) {
+            for (size_t i = 0; i < list.size; ++i) {
+                if (list.move[i].from == hit.from && list.move[i].to() == hit.to) {
+                    first = &list.move[i];
+                    break;
+                }
+            }
+        }
+        int32_t score[move_list_t::MAX_MOVES];
+        score_moves(list, first, ply, score);
+        // children searched with no depth left are mostly leaves. most
+        // nodes cut off on their first move, but once that has failed the
+        // rest are likely all searched, so score them at once with the
+        // vector kernel. the network keeps its own incremental scores
+        const bool batch_leaves = !net && depth <= 1 && ply+1 < MAX_PLY-1;
+        int32_t * scores = nullptr;
+        const int32_t alpha_in = alpha;
+        int32_t best = -INF;
+        size_t best_index = list.size;
+        for (size_t i = 0; i < list.size; ++i) {
+            if (batch_leaves && i == 1) {
+                scores = leaf[ply].data();
+                evaluate_children(pos, turn, list, i, scores);
+            }
+            pick_move(list, score, scores, i);
+            const bitmove_t & m = list.move[i];
+            bitboard_t child = pos;
+            child.apply(m, turn);
+            const uint64_t child_key = key ^ zobrist_t::delta(pos, m, turn);
+            if (net) {
+                net->update(acc[ply], pos, m, turn, acc[ply+1]);
+            }
+            // the batched score, handed to each search of this child
+            const int32_t * child_eval = scores ? &scores[i] : nullptr;
+            int32_t value;
+            // principal variation search
+            if (i == 0) {
+                known_eval = child_eval;
+                value = -search(child, child_key, opponent(turn), depth-1, ply+1, -beta, -alpha);
+            }
+            else {
+                // late quiet moves are searched with reduced depth first
+                const int32_t reduce = (i >= 3 && depth >= 3 && !capture) ? 1 : 0;
+                known_eval = child_eval;
+                value = -search(child, child_key, opponent(turn), depth-1-reduce, ply+1, -alpha-1, -alpha);
+                if (reduce && value > alpha) {
+                    known_eval = child_eval;
+                    value = -search(child, child_key, opponent(turn), depth-1, ply+1, -alpha-1, -alpha);
+                }
+                if (value > alpha && value < beta) {
+                    known_eval = child_eval;
+                    value = -search(child, child_key, opponent(turn), depth-1, ply+1, -beta, -alpha);
+                }
+            }
+            if (aborted) {
+                return 0;
+            }
+            if (value > best) {
+                best = value;
+                if (value > alpha) {
+                    alpha = value;
+                    best_index = i;
+                    update_pv(m, ply);
+                    if (alpha >= beta) {
+                        update_cutoff(m, depth, ply);
+                        break;
+                    }
+                }
+            }
+        }
+        // save the result for later visits to this position
+        tt_t::hit_t entry;
+        entry.depth = std::max(depth, 0);
+        entry.score = to_tt(best, ply);
+        entry.bound = (best >= beta)     ? tt_t::LOWER :
+                      (best <= alpha_in) ? tt_t::UPPER : tt_t::EXACT;
+        entry.from = entry.to = 0;
+        if (best_index < list.size) {
+            entry.from = list.move[best_index].from;
+            entry.to = list.move[best_index].to();
+        }
+        tt->store(key, entry);
+        return best;
+    }
+
+    // search every root move to a given depth
+    int32_t search_root(const bitboard_t & pos,
+                        colour_e turn,
+                        int32_t depth,
+                        move_list_t & list,
+                        bitmove_t & best_move)
+    {
+        pv_length[0] = 0;
+        int32_t score[move_list_t::MAX_MOVES];
+        score_moves(list, &best_move, 0, score);
+        int32_t alpha = -INF;
+        const int32_t beta = INF;
+        const uint64_t key = zobrist_t::hash(pos) ^
+                             (turn == BLACK ? zobrist_t::side_key : 0);
+        // the only accumulator built from scratch, the rest follow moves
+        if (net) {
+            net->refresh(pos, acc[0]);
+        }
+        for (size_t i = 0; i < list.size; ++i) {
+            pick_move(list, score, nullptr, i);
+            const bitmove_t & m = list.move[i];
+            bitboard_t child = pos;
+            child.apply(m, turn);
+            const uint64_t child_key = key ^ zobrist_t::delta(pos, m, turn);
+            if (net) {
+                net->update(acc[0], pos, m, turn, acc[1]);
+            }
+            int32_t value;
+            if (i == 0) {
+                value = -search(child, child_key, opponent(turn), depth-1, 1, -beta, -alpha);
+            }
+            else {
+                value = -search(child, child_key, opponent(turn), depth-1, 1, -alpha-1, -alpha);
+                if (value > alpha) {
+                    value = -search(child, child_key, opponent(turn), depth-1, 1, -beta, -alpha);
+                }
+            }
+            if (aborted) {
+                break;
+            }
+            if (value > alpha) {
+                alpha = value;
+                best_move = m;
+                update_pv(m, 0);
+            }
+        }
+        return alpha;
+    }
+
+    // iterative deepening loop over a list of root moves
+    void iterate(const bitboard_t & pos,
+                 colour_e turn,
+                 const search_limits_t & limits,
+                 steady_clock_t::time_point start,
+                 int32_t first_depth,
+                 move_list_t list,
+                 bitmove_t & best,
+                 search_info_t & info)
+    {
+        nodes = 0;
+        aborted = false;
+        timed = limits.time_ms > 0;
+        deadline = start + std::chrono::milliseconds(limits.time_ms);
+        // age the ordering tables from the last search
+        for (auto & k : killer) {
+            k[0].hops = k[1].hops = 0;
+        }
+        for (auto & row : history) {
+            for (int32_t & v : row) {
+                v /= 8;
+            }
+        }
+        prev_pv_length = 0;
+        const int32_t max_depth = limits.depth > 0 ? limits.depth : MAX_PLY/2;
+        for (int32_t depth = first_depth; depth <= max_depth; ++depth) {
+            bitmove_t iter_best = best;
+            const int32_t value = search_root(pos, turn, depth, list, iter_best);
+            // the first root move is the previous best so even a partial
+            // iteration that has searched it can be trusted
+            best = iter_best;
+            if (aborted) {
+                break;
+            }
+            info.depth = depth;
+            info.score = value;
+            // order the next iteration along this iterations best line
+            prev_pv = pv[0];
+            prev_pv_length = pv_length[0];
+            // stop early once a forced win or loss has been found
+            if (value > WIN - MAX_PLY || value < -(WIN - MAX_PLY)) {
+                break;
+            }
+        }
+    }
+};
+
+} // namespace {}
+
+// lazy smp: every thread searches the same root and they cooperate only
+// through the shared transposition table, with helpers starting at
+// staggered depths and root orders so they fill in different subtrees
+struct search_t::impl_t
+{
+    // results of earlier searches shared by every worker
+    tt_t tt;
+    // signal for all workers to stop
+    std::atomic<bool> stop;
+    // a stop asked for before the next search started
+    std::atomic<bool> stop_asked;
+    // one worker per search thread
+    std::vector<std::unique_ptr<worker_t>> workers;
+
+    // endgame tablebase given to every worker
+    const tablebase_t * tb;
+    // evaluation network given to every worker
+    const nnue_t * net;
+
+    impl_t()
+        : stop(false)
+        , stop_asked(false)
+        , tb(nullptr)
+        , net(nullptr)
+    {
+        tt.resize(DEFAULT_HASH_MB);
+        set_threads(1);
+    }
+
+    bool set_threads(int32_t count)
+    {
+        if (count < 1) {
+            return false;
+        }
+        workers.clear();
+        for (int32_t i = 0; i < count; ++i) {
+            workers.emplace_back(new worker_t(&tt, &stop));
+            workers.back()->tb = tb;
+            workers.back()->net = net;
+        }
+        return true;
+    }
+
+    bool think(const bitboard_t & pos,
+               colour_e turn,
+               const search_limits_t & limits,
+               bitmove_t & best,
+               search_info_t & info)
+    {
+        const auto start = steady_clock_t::now();
+        memset(&info, 0, sizeof(info));
+        // a stop that arrived before we started still ends this search,
+        // one that arrives from here on is seen through stop directly
+        stop.store(false);
+        if (stop_asked.exchange(false)) {
+            stop.store(true);
+        }
+        move_list_t list;
+        if (!pos.generate(turn, list) || list.size == 0) {
+            return false;
+        }
+        best = list.move[0];
+        // no need to search when there is only one choice
+        if (list.size == 1) {
+            return true;
+        }
+        tt.new_search();
+        // start the helper threads
+        std::vector<std::thread> helpers;
+        std::vector<bitmove_t> helper_best(workers.size(), best);
+        std::vector<search_info_t> helper_info(workers.size(), info);
+        for (size_t i = 1; i < workers.size(); ++i) {
+            // rotate the root moves so helpers diverge from the main thread
+            move_list_t rotated = list;
+            std::rotate(rotated.move.begin(),
+                        rotated.move.begin() + (i % list.size),
+                        rotated.move.begin() + list.size);
+            helpers.emplace_back(&worker_t::iterate,
+                                 workers[i].get(),
+                                 std::cref(pos),
+                                 turn,
+                                 std::cref(limits),
+                                 start,
+                                 int32_t(1 + (i & 1)),
+                                 rotated,
+                                 std::ref(helper_best[i]),
+                                 std::ref(helper_info[i]));
+        }
+        // the main thread decides the move
+        workers[0]->iterate(pos, turn, limits, start, 1, list, best, info);
+        stop.store(true);
+        // a stop that raced the end of this search is spent
+        stop_asked.store(false);
+        for (std::thread & t : helpers) {
+            t.join();
+        }
+        info.nodes = 0;
+        for (const auto & w : workers) {
+            info.nodes += w->nodes;
+        }
+        info.time_ms = int32_t(std::chrono::duration_cast<std::chrono::milliseconds>(
+            steady_clock_t::now() - start).count());
+        return true;
+    }
+};
+
+search_t::search_t()
+    : imp_(new search_t::impl_t)
+{
+}
+
+search_t::~search_t()
+{
+    delete imp_;
+}
+
+bool search_t::set_hash_size(size_t mb)
+{
+    return imp_->tt.resize(mb);
+}
+
+bool search_t::set_threads(int32_t count)
+{
+    return imp_->set_threads(count);
+}
+
+bool search_t::set_tablebase(const tablebase_t * tb)
+{
+    imp_->tb = tb;
+    for (auto & w : imp_->workers) {
+        w->tb = tb;
+    }
+    return true;
+}
+
+bool search_t::set_network(const nnue_t * net)
+{
+    imp_->net = net;
+    for (auto & w : imp_->workers) {
+        w->net = net;
+    }
+    return true;
+}
+
+void search_t::stop()
+{
+    // kept until the next search when none is running
+    imp_->stop_asked.store(true);
+    imp_->stop.store(true);
+}
+
+bool search_t::think(const bitboard_t & pos,
+                     colour_e turn,
+                     const search_limits_t & limits,
+                     bitmove_t & best,
+                     search_info_t & info)
+{
+    return imp_->think(pos, turn, limits, best, info);
+}
@@ -0,0 +1,455 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "checkers.h"
+
+namespace {
+
+typedef std::chrono::steady_clock steady_clock_t;
+
+// move time histogram buckets, each twice as wide as the last
+const size_t TIME_BUCKETS = 12;
+
+struct options_t
+{
+    int32_t games;
+    int32_t threads;
+    // games still running after this many plies are adjudicated drawn
+    int32_t max_plies;
+    // plies at the start of each game played at random
+    int32_t opening_plies;
+    uint32_t seed;
+    const char * pdn_path;
+    engine_config_t engine[2];
+};
+
+// what happened over a batch of games, from engine A's point of view
+struct tally_t
+{
+    uint64_t wins, draws, losses;
+    uint64_t plies;
+    // adjudicated draws, included in draws
+    uint64_t capped;
+    // move times per engine, bucket i counts moves under 2^i ms
+    std::array<std::array<uint64_t, TIME_BUCKETS>, 2> times;
+    std::array<double, 2> total_ms;
+    std::array<uint64_t, 2> moves;
+
+    void clear()
+    {
+        memset(this, 0, sizeof(*this));
+    }
+
+    void add(const tally_t & t)
+    {
+        wins += t.wins;
+        draws += t.draws;
+        losses += t.losses;
+        plies += t.plies;
+        capped += t.capped;
+        for (size_t e = 0; e < 2; ++e) {
+            for (size_t i = 0; i < TIME_BUCKETS; ++i) {
+                times[e][i] += t.times[e][i];
+            }
+            total_ms[e] += t.total_ms[e];
+            moves[e] += t.moves[e];
+        }
+    }
+
+    void time_move(size_t engine, double ms)
+    {
+        size_t bucket = 0;
+        while (bucket + 1 < TIME_BUCKETS && ms >= double(1u << bucket)) {
+            ++bucket;
+        }
+        ++times[engine][bucket];
+        total_ms[engine] += ms;
+        ++moves[engine];
+    }
+};
+
+// wraps an engine so the opening plies are played at random, giving
+// every game a different start, and so each move can be timed
+struct match_player_t : public player_t
+{
+    match_player_t(player_t * e,
+                   size_t index,
+                   int32_t opening_plies,
+                   uint32_t seed,
+                   tally_t & t)
+        : player_t(e->colour)
+        , engine(e)
+        , engine_index(index)
+        , opening(opening_plies)
+        , plies(0)
+        , random(seed)
+        , tally(t)
+    {
+        board_t board;
+        board.reset();
+        bits = board.bits;
+    }
+
+    virtual ~match_player_t()
+    {
+        delete engine;
+    }
+
+    virtual bool is_connected()
+    {
+        return engine->is_connected();
+    }
+
+    virtual bool poll_move(move_t & out)
+    {
+        out.clear();
+        if (!pending.empty()) {
+            out = pending;
+            pending.clear();
+        }
+        else if (!engine->poll_move(out)) {
+            return false;
+        }
+        else if (out.size()) {
+            // only the engines own moves are timed
+            const double ms = std::chrono::duration<double, std::milli>(
+                steady_clock_t::now() - asked).count();
+            tally.time_move(engine_index, ms);
+        }
+        if (out.size()) {
+            track(out, colour);
+        }
+        return true;
+    }
+
+    virtual bool invalid_move(const move_t & move)
+    {
+        return engine->invalid_move(move);
+    }
+
+    virtual bool send_move(const move_t & move)
+    {
+        track(move, colour == WHITE ? BLACK : WHITE);
+        return engine->send_move(move);
+    }
+
+    virtual bool send_board(const board_t & board)
+    {
+        bits = board.bits;
+        return engine->send_board(board);
+    }
+
+    virtual bool send_events(const event_list_t & events,
+                             const board_t & board)
+    {
+        return engine->send_events(events, board);
+    }
+
+    virtual bool send_colour(colour_e c)
+    {
+        return engine->send_colour(c);
+    }
+
+    virtual bool request_move()
+    {
+        asked = steady_clock_t::now();
+        if (plies >= opening) {
+            return engine->request_move();
+        }
+        // pick a random legal move and bring the engine up to date
+        move_list_t list;
+        if (!bits.generate(colour, list) || list.size == 0) {
+            return engine->request_move();
+        }
+        const bitmove_t & m = list.move[random() % list.size];
+        m.to_move(pending);
+        bitboard_t after = bits;
+        after.apply(m, colour);
+        board_t board;
+        return after.to_board(board) && engine->send_board(board);
+    }
+
+    virtual bool bad_input()
+    {
+        return engine->bad_input();
+    }
+
+    virtual int wait_fd()
+    {
+        return pending.empty() ? engine->wait_fd() : -1;
+    }
+
+protected:
+    void track(const move_t & move, colour_e turn)
+    {
+        move_list_t list;
+        if (bits.generate(turn, list)) {
+            if (const bitmove_t * m = list.find(move)) {
+                bits.apply(*m, turn);
+            }
+        }
+        ++plies;
+    }
+
+    player_t * engine;
+    // 0 for engine A, 1 for engine B
+    size_t engine_index;
+    int32_t opening;
+    int32_t plies;
+    std::mt19937 random;
+    bitboard_t bits;
+    // random opening move waiting to be collected
+    move_t pending;
+    steady_clock_t::time_point asked;
+    tally_t & tally;
+};
+
+// play one game, engine A taking black in even games; both games of a
+// pair share a seed and start with black to move, so each opening is
+// played from both sides
+void play(int32_t index,
+          const options_t & opt,
+          pdn_writer_t * recorder,
+          tally_t & tally)
+{
+    const uint32_t seed = opt.seed + uint32_t(index / 2);
+    const colour_e a_colour = (index & 1) ? WHITE : BLACK;
+    const colour_e b_colour = (index & 1) ? BLACK : WHITE;
+    match_player_t * a = new match_player_t(
+        new_engine_player(a_colour, opt.engine[0]),
+        0, opt.opening_plies, seed, tally);
+    match_player_t * b = new match_player_t(
+        new_engine_player(b_colour, opt.engine[1]),
+        1, opt.opening_plies, seed, tally);
+    std::array<player_t *, 2> players = {a, b};
+    {
+        // black moves first, which is engine B in odd games
+        checkers_t game(players, nullptr, recorder, int32_t(index & 1));
+        while (game.is_active()) {
+            const int32_t before = game.plies();
+            game.poll_players();
+            if (game.plies() == before) {
+                game.wait_players();
+            }
+            if (game.plies() >= opt.max_plies) {
+                game.end();
+            }
+        }
+        tally.plies += uint64_t(game.plies());
+        switch (game.record().result) {
+        case (pdn_game_t::WHITE_WIN):
+            (a_colour == WHITE ? tally.wins : tally.losses) += 1;
+            break;
+        case (pdn_game_t::BLACK_WIN):
+            (a_colour == BLACK ? tally.wins : tally.losses) += 1;
+            break;
+        default:
+            ++tally.draws;
+            tally.capped += game.plies() >= opt.max_plies ? 1 : 0;
+            break;
+        }
+    }
+    delete a;
+    delete b;
+}
+
+// elo difference for an expected score
+double elo(double score)
+{
+    score = std::min(std::max(score, 1e-6), 1.0 - 1e-6);
+    return -400.0 * std::log10(1.0 / score - 1.0);
+}
+
+void report(const tally_t & t, double secs)
+{
+    const uint64_t games = t.wins + t.draws + t.losses;
+    if (games == 0) {
+        return;
+    }
+    const double n = double(games);
+    const double score = (double(t.wins) + 0.5 * double(t.draws)) / n;
+    // spread of a single game's score about the mean
+    const double var = (double(t.wins)   * (1.0 - score) * (1.0 - score) +
+                        double(t.draws)  * (0.5 - score) * (0.5 - score) +
+                        double(t.losses) * (0.0 - score) * (0.0 - score)) / n;
+    // 95% confidence interval on the mean score
+    const double margin = 1.96 * std::sqrt(var / n);
+    printf("games %llu  +%llu =%llu -%llu  (%llu drawn at the ply limit)\n",
+           (unsigned long long)games,
+           (unsigned long long)t.wins,
+           (unsigned long long)t.draws,
+           (unsigned long long)t.losses,
+           (unsigned long long)t.capped);
+    printf("score %.1f%%  elo %+.1f  [%+.1f, %+.1f]\n",
+           score * 100.0,
+           elo(score),
+           elo(score - margin),
+           elo(score + margin));
+    printf("time %.2fs  %.2f games/sec  %.1f plies/game\n",
+           secs,
+           secs > 0.0 ? n / secs : 0.0,
+           double(t.plies) / n);
+    for (size_t e = 0; e < 2; ++e) {
+        if (t.moves[e] == 0) {
+            continue;
+        }
+        printf("engine %c move times (%llu moves, mean %.2fms)\n",
+               e == 0 ? 'A' : 'B',
+               (unsigned long long)t.moves[e],
+               t.total_ms[e] / double(t.moves[e]));
+        for (size_t i = 0; i < TIME_BUCKETS; ++i) {
+            if (t.times[e][i] == 0) {
+                continue;
+            }
+            const double share = double(t.times[e][i]) / double(t.moves[e]);
+            char label[32];
+            if (i + 1 == TIME_BUCKETS) {
+                snprintf(label, sizeof(label), ">= %ums", 1u << (i - 1));
+            }
+            else {
+                snprintf(label, sizeof(label), "<  %ums", 1u << i);
+            }
+            printf("  %-10s %8llu  %5.1f%%  ",
+                   label,
+                   (unsigned long long)t.times[e][i],
+                   share * 100.0);
+            for (int32_t bar = int32_t(share * 50.0); bar > 0; --bar) {
+                putchar('#');
+            }
+            putchar('\n');
+        }
+    }
+}
+
+void usage()
+{
+    printf("usage: checkers_selfplay [options]\n");
+    printf("  -games <n>      games to play (default 100)\n");
+    printf("  -threads <n>    games played at once (default one per core)\n");
+    printf("  -plies <n>      adjudicate a draw after this many plies (default 300)\n");
+    printf("  -opening <n>    random plies at the start of each game (default 4)\n");
+    printf("  -seed <n>       seed for the random openings\n");
+    printf("  -pdn <file>     append every game to a PDN file\n");
+    printf("  -adepth <n>     engine A search depth (default 6)\n");
+    printf("  -atime <ms>     engine A time per move (default 0, no limit)\n");
+    printf("  -ahash <mb>     engine A hash size (default 4)\n");
+    printf("  -abook <file>   engine A opening book\n");
+    printf("  -annue <file>   engine A evaluation network\n");
+    printf("  -bdepth, -btime, -bhash, -bbook, -bnnue  the same for engine B\n");
+}
+
+} // namespace {}
+
+int main(int argc, char * args[])
+{
+    options_t opt;
+    opt.games = 100;
+    opt.threads = int32_t(std::max(1u, std::thread::hardware_concurrency()));
+    opt.max_plies = 300;
+    opt.opening_plies = 4;
+    opt.seed = std::random_device()();
+    opt.pdn_path = nullptr;
+    for (engine_config_t & e : opt.engine) {
+        e = engine_config_t{{6, 0}, 4, 1, nullptr, 8, nullptr, true, nullptr};
+    }
+    for (int i = 1; i < argc; ++i) {
+        const char * arg = args[i];
+        const bool has_value = i+1 < argc;
+        // per engine options start with -a or -b
+        engine_config_t * e = nullptr;
+        if (arg[0] == '-' && (arg[1] == 'a' || arg[1] == 'b')) {
+            e = &opt.engine[arg[1] == 'a' ? 0 : 1];
+            arg += 2;
+        }
+        if (!has_value) {
+            usage();
+            return 1;
+        }
+        const char * value = args[++i];
+        if (e && strcmp(arg, "depth") == 0) {
+            e->limits.depth = atoi(value);
+        }
+        else if (e && strcmp(arg, "time") == 0) {
+            e->limits.time_ms = atoi(value);
+        }
+        else if (e && strcmp(arg, "hash") == 0) {
+            e->hash_mb = atoi(value);
+        }
+        else if (e && strcmp(arg, "book") == 0) {
+            e->book_path = value;
+        }
+        else if (e && strcmp(arg, "nnue") == 0) {
+            e->nnue_path = value;
+        }
+        else if (e) {
+            usage();
+            return 1;
+        }
+        else if (strcmp(arg, "-games") == 0) {
+            opt.games = atoi(value);
+        }
+        else if (strcmp(arg, "-threads") == 0) {
+            opt.threads = std::max(1, atoi(value));
+        }
+        else if (strcmp(arg, "-plies") == 0) {
+            opt.max_plies = atoi(value);
+        }
+        else if (strcmp(arg, "-opening") == 0) {
+            opt.opening_plies = atoi(value);
+        }
+        else if (strcmp(arg, "-seed") == 0) {
+            opt.seed = uint32_t(strtoul(value, nullptr, 10));
+        }
+        else if (strcmp(arg, "-pdn") == 0) {
+            opt.pdn_path = value;
+        }
+        else {
+            usage();
+            return 1;
+        }
+    }
+
+    pdn_writer_t recorder;
+    if (opt.pdn_path && !recorder.open(opt.pdn_path)) {
+        printf("unable to open '%s'\n", opt.pdn_path);
+        return 1;
+    }
+    printf("%d games on %d threads, seed %u\n", opt.games, opt.threads, opt.seed);
+
+    std::atomic<int32_t> next(0);
+    std::mutex lock;
+    tally_t total;
+    total.clear();
+    const auto start = steady_clock_t::now();
+    // each worker takes the next unplayed game until none are left
+    auto worker = [&]() {
+        tally_t local;
+        local.clear();
+        for (int32_t index = next++; index < opt.games; index = next++) {
+            log_scope_t scope(uint32_t(index + 1), 0);
+            play(index, opt, opt.pdn_path ? &recorder : nullptr, local);
+        }
+        std::lock_guard<std::mutex> guard(lock);
+        total.add(local);
+    };
+    std::vector<std::thread> pool;
+    for (int32_t i = 0; i < opt.threads; ++i) {
+        pool.emplace_back(worker);
+    }
+    for (std::thread & t : pool) {
+        t.join();
+    }
+    const double secs = std::chrono::duration<double>(
+        steady_clock_t::now() - start).count();
+    recorder.close();
+    report(total, secs);
+    return 0;
+}
@@ -19,6 +19,8 @@ protected:
 
     bool poll_input()
     {
+        // keep log lines from landing after the prompt
+        log_flush();
         // ask player to make a move
         printf("%s move: ", colour==WHITE ? "white" : "black");
         // read move from stdin
@@ -71,7 +73,9 @@ public:
             if (!str_to_pos(&input[i], p)) {
                 break;
             }
-            move.push_back(p);
+            if (!move.push_back(p)) {
+                return false;
+            }
         }
         // must have two coordinates for valid move
         return move.size() >= 2;
@@ -111,6 +115,13 @@ public:
         return true;
     }
 
+    virtual bool send_events(const event_list_t & events,
+                             const board_t & board)
+    {
+        // redraw the whole board for a human
+        return send_board(board);
+    }
+
     virtual bool send_colour(colour_e c)
     {
         return true;
@@ -0,0 +1,705 @@
+#if !defined(_MSC_VER)
+ #include <fcntl.h>
+ #include <sys/mman.h>
+ #include <sys/stat.h>
+ #include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+
+#include "checkers.h"
+
+namespace {
+
+// largest number of pieces on each side of a slice
+const int32_t MAX_SIDE = 8;
+
+const char TB_MAGIC[4] = {'C', 'K', 'T', 'B'};
+const uint32_t TB_VERSION = 1;
+
+// slice file header, followed by one byte per position with white to move
+// and then one byte per position with black to move
+//
+//  value 0        draw
+//  value 1..127   side to move wins in this many plies
+//  value 128..255 side to move loses in (value-128) plies
+struct tb_header_t
+{
+    char magic[4];
+    uint32_t version;
+    // {white men, white kings, black men, black kings}
+    uint8_t counts[4];
+    uint32_t reserved;
+    // positions per side to move
+    uint64_t entries;
+};
+
+const uint8_t TB_LOSS = 128;
+const int32_t TB_MAX_DISTANCE = 127;
+
+// binomial coefficients C(n, k)
+struct choose_t
+{
+    uint64_t table[33][MAX_SIDE+1];
+
+    choose_t()
+    {
+        for (int32_t n = 0; n <= 32; ++n) {
+            table[n][0] = 1;
+            for (int32_t k = 1; k <= MAX_SIDE; ++k) {
+                table[n][k] = (n == 0) ? 0 : table[n-1][k-1] + table[n-1][k];
+            }
+        }
+    }
+
+    uint64_t operator () (int32_t n, int32_t k) const
+    {
+        return (n < 0 || k < 0 || k > n) ? 0 : table[n][k];
+    }
+} choose;
+
+// piece counts identifying a slice
+struct counts_t
+{
+    int32_t wm, wk, bm, bk;
+
+    int32_t pieces() const { return wm + wk + bm + bk; }
+    int32_t men() const { return wm + bm; }
+
+    // positions in this slice for one side to move
+    uint64_t entries() const
+    {
+        return choose(32, wm) *
+               choose(32 - wm, bm) *
+               choose(32 - wm - bm, wk) *
+               choose(32 - wm - bm - wk, bk);
+    }
+
+    static counts_t of(const bitboard_t & b)
+    {
+        counts_t c;
+        c.wm = bitboard_t::count(b.white & ~b.kings);
+        c.wk = bitboard_t::count(b.white & b.kings);
+        c.bm = bitboard_t::count(b.black & ~b.kings);
+        c.bk = bitboard_t::count(b.black & b.kings);
+        return c;
+    }
+
+    bool operator == (const counts_t & rhs) const
+    {
+        return wm==rhs.wm && wk==rhs.wk && bm==rhs.bm && bk==rhs.bk;
+    }
+};
+
+// colex rank of a set of squares among the squares not yet occupied
+uint64_t rank_set(uint32_t set, uint32_t occupied)
+{
+    uint64_t out = 0;
+    int32_t i = 1;
+    for (uint32_t m = set; m; m &= m-1, ++i) {
+        const int32_t sq = bitboard_t::lsb(m);
+        const int32_t free_rank = sq - bitboard_t::count(occupied & ((1u << sq) - 1));
+        out += choose(free_rank, i);
+    }
+    return out;
+}
+
+// inverse of rank_set
+uint32_t unrank_set(uint64_t rank, int32_t k, uint32_t occupied)
+{
+    uint32_t out = 0;
+    int32_t p = 32;
+    for (int32_t i = k; i >= 1; --i) {
+        // largest free rank p with C(p, i) <= rank
+        do {
+            --p;
+        } while (choose(p, i) > rank);
+        rank -= choose(p, i);
+        // find the p'th unoccupied square
+        int32_t seen = -1;
+        for (int32_t sq = 0; sq < 32; ++sq) {
+            if (!(occupied & (1u << sq)) && ++seen == p) {
+                out |= 1u << sq;
+                break;
+            }
+        }
+    }
+    return out;
+}
+
+// perfect hash of a position within its slice
+uint64_t index_of(const bitboard_t & b, const counts_t & c)
+{
+    const uint32_t wm = b.white & ~b.kings;
+    const uint32_t bm = b.black & ~b.kings;
+    const uint32_t wk = b.white & b.kings;
+    const uint32_t bk = b.black & b.kings;
+    uint64_t index = rank_set(wm, 0);
+    index = index * choose(32 - c.wm, c.bm) + rank_set(bm, wm);
+    index = index * choose(32 - c.wm - c.bm, c.wk) + rank_set(wk, wm | bm);
+    index = index * choose(32 - c.wm - c.bm - c.wk, c.bk) + rank_set(bk, wm | bm | wk);
+    return index;
+}
+
+// inverse of index_of, returns false if men sit on their crowning row
+bool position_of(uint64_t index, const counts_t & c, bitboard_t & out)
+{
+    const uint64_t n_bk = choose(32 - c.wm - c.bm - c.wk, c.bk);
+    const uint64_t n_wk = choose(32 - c.wm - c.bm, c.wk);
+    const uint64_t n_bm = choose(32 - c.wm, c.bm);
+    const uint64_t r_bk = index % n_bk; index /= n_bk;
+    const uint64_t r_wk = index % n_wk; index /= n_wk;
+    const uint64_t r_bm = index % n_bm; index /= n_bm;
+    const uint32_t wm = unrank_set(index, c.wm, 0);
+    const uint32_t bm = unrank_set(r_bm, c.bm, wm);
+    const uint32_t wk = unrank_set(r_wk, c.wk, wm | bm);
+    const uint32_t bk = unrank_set(r_bk, c.bk, wm | bm | wk);
+    out.white = wm | wk;
+    out.black = bm | bk;
+    out.kings = wk | bk;
+    return !(wm & bitboard_t::WHITE_CROWN_ROW) &&
+           !(bm & bitboard_t::BLACK_CROWN_ROW);
+}
+
+// slot for a slice in the table of mapped files
+int32_t slot_of(const counts_t & c)
+{
+    if (c.wm > MAX_SIDE || c.wk > MAX_SIDE || c.bm > MAX_SIDE || c.bk > MAX_SIDE) {
+        return -1;
+    }
+    const int32_t n = MAX_SIDE + 1;
+    return ((c.wm * n + c.wk) * n + c.bm) * n + c.bk;
+}
+
+std::string slice_path(const char * dir, const counts_t & c)
+{
+    char name[32];
+    snprintf(name, sizeof(name), "/w%d%db%d%d.ctb", c.wm, c.wk, c.bm, c.bk);
+    return std::string(dir) + name;
+}
+
+} // namespace {}
+
+struct tablebase_t::impl_t
+{
+    // a memory mapped slice file
+    struct slice_t
+    {
+        void * base;
+        size_t size;
+        const uint8_t * values;
+        uint64_t entries;
+    };
+
+    std::vector<slice_t> slices;
+    int32_t max_pieces;
+
+    impl_t()
+        : slices((MAX_SIDE+1) * (MAX_SIDE+1) * (MAX_SIDE+1) * (MAX_SIDE+1))
+        , max_pieces(0)
+    {
+        for (slice_t & s : slices) {
+            s = slice_t{nullptr, 0, nullptr, 0};
+        }
+    }
+
+    ~impl_t()
+    {
+        close();
+    }
+
+    void close()
+    {
+#if !defined(_MSC_VER)
+        for (slice_t & s : slices) {
+            if (s.base) {
+                munmap(s.base, s.size);
+            }
+            s = slice_t{nullptr, 0, nullptr, 0};
+        }
+#endif
+        max_pieces = 0;
+    }
+
+    // map one slice file if it exists
+    bool map(const char * dir, const counts_t & c)
+    {
+#if defined(_MSC_VER)
+        return false;
+#else
+        const int32_t slot = slot_of(c);
+        if (slot < 0) {
+            return false;
+        }
+        const std::string path = slice_path(dir, c);
+        const int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return false;
+        }
+        struct stat st;
+        if (fstat(fd, &st) != 0 || size_t(st.st_size) < sizeof(tb_header_t)) {
+            ::close(fd);
+            return false;
+        }
+        void * base = mmap(nullptr, size_t(st.st_size), PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (base == MAP_FAILED) {
+            return false;
+        }
+        // validate the header against the slice we expect
+        const tb_header_t * header = (const tb_header_t *)base;
+        const uint8_t counts[4] = {uint8_t(c.wm), uint8_t(c.wk), uint8_t(c.bm), uint8_t(c.bk)};
+        if (memcmp(header->magic, TB_MAGIC, 4) != 0 ||
+            header->version != TB_VERSION ||
+            memcmp(header->counts, counts, 4) != 0 ||
+            header->entries != c.entries() ||
+            size_t(st.st_size) < sizeof(tb_header_t) + 2 * header->entries) {
+            log(LOG_WARN, "tablebase: bad slice file '%s'", path.c_str());
+            munmap(base, size_t(st.st_size));
+            return false;
+        }
+        slice_t & s = slices[slot];
+        if (s.base) {
+            munmap(s.base, s.size);
+        }
+        s.base = base;
+        s.size = size_t(st.st_size);
+        s.values = (const uint8_t *)base + sizeof(tb_header_t);
+        s.entries = header->entries;
+        max_pieces = std::max(max_pieces, c.pieces());
+        return true;
+#endif
+    }
+
+    // raw stored value for a position, false if its slice is not mapped
+    bool lookup(const bitboard_t & b, colour_e turn, uint8_t & out) const
+    {
+        const counts_t c = counts_t::of(b);
+        const int32_t slot = slot_of(c);
+        if (slot < 0 || !slices[slot].values) {
+            return false;
+        }
+        const slice_t & s = slices[slot];
+        const uint64_t index = index_of(b, c);
+        out = s.values[(turn == WHITE ? 0 : s.entries) + index];
+        return true;
+    }
+};
+
+namespace {
+
+// every slice with up to a number of pieces in the order they must be
+// solved: captures lead to fewer pieces and crowning to fewer men
+std::vector<counts_t> slices_upto(int32_t max_pieces)
+{
+    std::vector<counts_t> out;
+    for (int32_t wm = 0; wm <= MAX_SIDE; ++wm)
+    for (int32_t wk = 0; wk <= MAX_SIDE; ++wk)
+    for (int32_t bm = 0; bm <= MAX_SIDE; ++bm)
+    for (int32_t bk = 0; bk <= MAX_SIDE; ++bk) {
+        const counts_t c = {wm, wk, bm, bk};
+        // both sides need at least one piece
+        if (wm + wk == 0 || bm + bk == 0 || c.pieces() > max_pieces) {
+            continue;
+        }
+        out.push_back(c);
+    }
+    std::stable_sort(out.begin(), out.end(),
+        [](const counts_t & a, const counts_t & b) {
+            if (a.pieces() != b.pieces()) {
+                return a.pieces() < b.pieces();
+            }
+            return a.men() < b.men();
+        });
+    return out;
+}
+
+// retrograde solver for one slice
+//
+//  each position is expanded forwards once, to score the moves that leave
+//  the slice (captures and crowning) from the slices already solved and to
+//  count the moves that stay in it. results then spread backwards through
+//  an unmove generator one ply at a time: a loss makes every predecessor a
+//  win, and a win makes a predecessor a loss once it has no moves left
+//  unresolved. values are kept in the one byte file format, next to one
+//  byte per position counting its unresolved moves.
+struct solver_t
+{
+    // set in a count when a move leaving the slice draws, so the position
+    // can never be lost
+    static const uint8_t CAN_DRAW = 0x80;
+    // count of a position settled for good, whose predecessors have been
+    // told or which can never be reached
+    static const uint8_t DONE = 0xff;
+
+    const counts_t counts;
+    const tablebase_t::impl_t & solved;
+    const uint64_t entries;
+    // white to move then black to move, as written to the file
+    std::vector<uint8_t> values;
+    std::vector<uint8_t> pending;
+    // positions given a win or loss at each distance, still to be passed
+    // on to their predecessors. a win shortened later is queued again and
+    // the stale entry skipped
+    std::vector<std::vector<uint64_t>> queued;
+
+    solver_t(const counts_t & c, const tablebase_t::impl_t & s)
+        : counts(c)
+        , solved(s)
+        , entries(c.entries())
+        , values(2 * entries, 0)
+        , pending(2 * entries, 0)
+        , queued(TB_MAX_DISTANCE + 1)
+    {
+    }
+
+    // settle a win or loss, to be passed on at its distance
+    void assign(uint64_t at, uint8_t v)
+    {
+        values[at] = v;
+        queued[distance(v)].push_back(at);
+    }
+
+    static uint8_t win(int32_t d)
+    {
+        return uint8_t(std::min(d, TB_MAX_DISTANCE));
+    }
+
+    static uint8_t loss(int32_t d)
+    {
+        return uint8_t(TB_LOSS + std::min(d, TB_MAX_DISTANCE));
+    }
+
+    static bool is_loss(uint8_t v)
+    {
+        return v >= TB_LOSS;
+    }
+
+    static int32_t distance(uint8_t v)
+    {
+        return is_loss(v) ? v - TB_LOSS : v;
+    }
+
+    uint64_t slot(const bitboard_t & b, colour_e turn) const
+    {
+        return (turn == WHITE ? 0 : entries) + index_of(b, counts);
+    }
+
+    // value of a position reached by a move leaving the slice
+    uint8_t external_value(const bitboard_t & child, colour_e turn) const
+    {
+        // a side with no pieces left has lost
+        if (!child.pieces(turn)) {
+            return loss(0);
+        }
+        uint8_t raw = 0;
+        if (!solved.lookup(child, turn, raw)) {
+            assert(!"tablebase slice solved out of order");
+        }
+        return raw;
+    }
+
+    // score a position from the moves that leave the slice, or count the
+    // moves that stay in it for the backwards pass to resolve
+    void expand(uint64_t at, const bitboard_t & b, colour_e turn)
+    {
+        const colour_e other = (turn == WHITE) ? BLACK : WHITE;
+        move_list_t list;
+        b.generate(turn, list);
+        int32_t shortest_win = -1;
+        int32_t longest_loss = 0;
+        bool can_draw = false;
+        uint8_t inside = 0;
+        for (size_t i = 0; i < list.size; ++i) {
+            bitboard_t child = b;
+            child.apply(list.move[i], turn);
+            if (counts_t::of(child) == counts) {
+                ++inside;
+                continue;
+            }
+            const uint8_t v = external_value(child, other);
+            if (is_loss(v)) {
+                const int32_t d = distance(v) + 1;
+                shortest_win = (shortest_win < 0) ? d : std::min(shortest_win, d);
+            }
+            else if (v == 0) {
+                can_draw = true;
+            }
+            else {
+                longest_loss = std::max(longest_loss, distance(v) + 1);
+            }
+        }
+        assert(inside < CAN_DRAW);
+        if (shortest_win >= 0) {
+            // may still be shortened by a move within the slice
+            assign(at, win(shortest_win));
+            pending[at] = inside;
+        }
+        else if (inside == 0) {
+            // no moves at all is a loss in 0 plies
+            if (can_draw) {
+                pending[at] = DONE;
+            }
+            else {
+                assign(at, loss(longest_loss));
+            }
+        }
+        else {
+            pending[at] = uint8_t(inside | (can_draw ? CAN_DRAW : 0));
+        }
+    }
+
+    // a position whose every move wins for the opponent loses as late as
+    // it can
+    uint8_t lost_value(const bitboard_t & b, colour_e turn) const
+    {
+        const colour_e other = (turn == WHITE) ? BLACK : WHITE;
+        move_list_t list;
+        b.generate(turn, list);
+        int32_t longest = 0;
+        for (size_t i = 0; i < list.size; ++i) {
+            bitboard_t child = b;
+            child.apply(list.move[i], turn);
+            const uint8_t v = (counts_t::of(child) == counts) ?
+                values[slot(child, other)] : external_value(child, other);
+            assert(v != 0 && !is_loss(v));
+            longest = std::max(longest, distance(v) + 1);
+        }
+        return loss(longest);
+    }
+
+    // call fn with every position in the slice that reaches b by a move
+    // staying in the slice, that is a step without crowning
+    template <typename fn_t>
+    void predecessors(const bitboard_t & b, colour_e turn, fn_t fn) const
+    {
+        const colour_e mover = (turn == WHITE) ? BLACK : WHITE;
+        const uint32_t own = b.pieces(mover);
+        const uint32_t empty = b.empty();
+        for (int32_t d = 0; d < 4; ++d) {
+            const bitboard_t::dir_e dir = bitboard_t::dir_e(d);
+            const bitboard_t::dir_e back = bitboard_t::reverse(dir);
+            // men only step forwards, kings were kings before they moved
+            const uint32_t movers = bitboard_t::is_forward(mover, dir) ?
+                own : (own & b.kings);
+            for (uint32_t m = movers; m; m &= m - 1) {
+                const uint32_t to = m & (0u - m);
+                const uint32_t from = bitboard_t::step(to, back) & empty;
+                if (!from) {
+                    continue;
+                }
+                bitboard_t p = b;
+                if (mover == WHITE) {
+                    p.white ^= to | from;
+                }
+                else {
+                    p.black ^= to | from;
+                }
+                if (b.kings & to) {
+                    p.kings ^= to | from;
+                }
+                // captures are forced so a step was only legal without one
+                if (p.jumpers(mover)) {
+                    continue;
+                }
+                fn(p, mover);
+            }
+        }
+    }
+
+    // pass the results settled at a distance on to their predecessors
+    void propagate(int32_t level)
+    {
+        std::vector<uint64_t> & queue = queued[level];
+        bitboard_t b;
+        // distances are clamped, so the last level can grow as it is read
+        for (size_t i = 0; i < queue.size(); ++i) {
+            const uint64_t at = queue[i];
+            const uint8_t v = values[at];
+            if (pending[at] == DONE || distance(v) != level) {
+                continue;
+            }
+            pending[at] = DONE;
+            position_of(at % entries, counts, b);
+            const colour_e turn = (at < entries) ? WHITE : BLACK;
+            predecessors(b, turn, [&](const bitboard_t & p, colour_e mover) {
+                const uint64_t from = slot(p, mover);
+                if (pending[from] == DONE) {
+                    return;
+                }
+                const uint8_t pv = values[from];
+                if (is_loss(v)) {
+                    // moving into a lost position wins, soonest first
+                    if (pv == 0 || distance(pv) > level + 1) {
+                        assign(from, win(level + 1));
+                    }
+                }
+                else if (pv == 0 && !(pending[from] & CAN_DRAW)) {
+                    // lost once every move has been shown to win for us
+                    if (--pending[from] == 0) {
+                        assign(from, lost_value(p, mover));
+                    }
+                }
+            });
+        }
+        std::vector<uint64_t>().swap(queue);
+    }
+
+    void solve()
+    {
+        bitboard_t b;
+        for (uint64_t i = 0; i < entries; ++i) {
+            if (!position_of(i, counts, b)) {
+                pending[i] = DONE;
+                pending[entries + i] = DONE;
+                continue;
+            }
+            for (int32_t side = 0; side < 2; ++side) {
+                expand(side * entries + i, b, colour_e(side));
+            }
+        }
+        // a result only ever settles results further away, so each
+        // distance is final once the ones before it are done
+        for (int32_t level = 0; level <= TB_MAX_DISTANCE; ++level) {
+            propagate(level);
+        }
+        // whatever is left unresolved is a draw
+        std::vector<uint8_t>().swap(pending);
+    }
+
+    bool write(const char * dir) const
+    {
+        const std::string path = slice_path(dir, counts);
+        FILE * fd = fopen(path.c_str(), "wb");
+        if (!fd) {
+            log(LOG_ERROR, "tablebase: unable to write '%s'", path.c_str());
+            return false;
+        }
+        tb_header_t header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, TB_MAGIC, 4);
+        header.version = TB_VERSION;
+        header.counts[0] = uint8_t(counts.wm);
+        header.counts[1] = uint8_t(counts.wk);
+        header.counts[2] = uint8_t(counts.bm);
+        header.counts[3] = uint8_t(counts.bk);
+        header.entries = entries;
+        bool ok = fwrite(&header, sizeof(header), 1, fd) == 1;
+        ok &= fwrite(values.data(), 1, values.size(), fd) == values.size();
+        ok &= fclose(fd) == 0;
+        return ok;
+    }
+};
+
+} // namespace {}
+
+tablebase_t::tablebase_t()
+    : imp_(new tablebase_t::impl_t)
+{
+}
+
+tablebase_t::~tablebase_t()
+{
+    delete imp_;
+}
+
+bool tablebase_t::open(const char * dir, int32_t max_pieces)
+{
+    imp_->close();
+    for (const counts_t & c : slices_upto(max_pieces)) {
+        imp_->map(dir, c);
+    }
+    return imp_->max_pieces > 0;
+}
+
+int32_t tablebase_t::pieces() const
+{
+    return imp_->max_pieces;
+}
+
+bool tablebase_t::probe(const bitboard_t & b,
+                        colour_e turn,
+                        result_e & result,
+                        int32_t & distance) const
+{
+    uint8_t raw;
+    if (!imp_->lookup(b, turn, raw)) {
+        return false;
+    }
+    if (raw == 0) {
+        result = DRAW;
+        distance = 0;
+    }
+    else if (raw >= TB_LOSS) {
+        result = LOSS;
+        distance = raw - TB_LOSS;
+    }
+    else {
+        result = WIN;
+        distance = raw;
+    }
+    return true;
+}
+
+bool tablebase_t::build(const char * dir, int32_t max_pieces, int32_t threads)
+{
+    if (max_pieces < 2 || max_pieces > MAX_SIDE * 2) {
+        return false;
+    }
+    threads = std::max(threads, 1);
+    tablebase_t solved;
+    const std::vector<counts_t> order = slices_upto(max_pieces);
+    size_t group_start = 0;
+    while (group_start < order.size()) {
+        // slices with the same piece and men counts never depend on one
+        // another so they are solved in parallel
+        size_t group_end = group_start;
+        while (group_end < order.size() &&
+               order[group_end].pieces() == order[group_start].pieces() &&
+               order[group_end].men() == order[group_start].men()) {
+            ++group_end;
+        }
+        std::atomic<size_t> next(group_start);
+        std::atomic<bool> ok(true);
+        auto worker = [&]() {
+            for (;;) {
+                const size_t i = next++;
+                if (i >= group_end) {
+                    return;
+                }
+                const counts_t & c = order[i];
+                solver_t solver(c, *solved.imp_);
+                solver.solve();
+                if (!solver.write(dir)) {
+                    ok = false;
+                }
+                log("tablebase: solved w%d%db%d%d (%llu positions)",
+                    c.wm, c.wk, c.bm, c.bk,
+                    (unsigned long long)c.entries());
+            }
+        };
+        std::vector<std::thread> pool;
+        for (int32_t t = 1; t < threads; ++t) {
+            pool.emplace_back(worker);
+        }
+        worker();
+        for (std::thread & t : pool) {
+            t.join();
+        }
+        if (!ok) {
+            return false;
+        }
+        // map the new slices so later groups can look them up
+        for (size_t i = group_start; i < group_end; ++i) {
+            if (!solved.imp_->map(dir, order[i])) {
+                log(LOG_ERROR, "tablebase: unable to map solved slice");
+                return false;
+            }
+        }
+        group_start = group_end;
+    }
+    return true;
+}
@@ -0,0 +1,48 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+
+#include "checkers.h"
+
+namespace {
+
+void usage()
+{
+    printf("usage: checkers_tbgen [options] <directory>\n");
+    printf("  -n <pieces>   largest number of pieces to solve (default 4)\n");
+    printf("  -t <threads>  worker threads (default all cores)\n");
+}
+
+} // namespace {}
+
+int main(int argc, char * args[])
+{
+    int32_t pieces = 4;
+    int32_t threads = int32_t(std::thread::hardware_concurrency());
+    const char * dir = nullptr;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(args[i], "-n") == 0 && i+1 < argc) {
+            pieces = atoi(args[++i]);
+        }
+        else if (strcmp(args[i], "-t") == 0 && i+1 < argc) {
+            threads = atoi(args[++i]);
+        }
+        else if (args[i][0] != '-' && !dir) {
+            dir = args[i];
+        }
+        else {
+            usage();
+            return 1;
+        }
+    }
+    if (!dir) {
+        usage();
+        return 1;
+    }
+    if (!tablebase_t::build(dir, pieces, threads)) {
+        log(LOG_ERROR, "unable to build tablebase");
+        return 1;
+    }
+    return 0;
+}
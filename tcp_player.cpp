@@ -3,11 +3,15 @@
  #include <winsock2.h>
  #include <ws2tcpip.h>
  #pragma comment(lib, "ws2_32.lib")
+// callers check readiness first as winsock has no per call flag
+ #define MSG_DONTWAIT 0
 #else
  #include <sys/socket.h>
  #include <sys/types.h>
  #include <netinet/in.h>
  #include <arpa/inet.h>
+ #include <unistd.h>
+ #include <cerrno>
 typedef int SOCKET;
 typedef void * PVOID;
 typedef sockaddr SOCKADDR;
@@ -15,73 +19,498 @@ constexpr int INVALID_SOCKET = -1;
 constexpr int SOCKET_ERROR = -1;
 #endif
 
+#include <algorithm>
+#include <chrono>
+#include <cstring>
 #include <memory>
+#include <thread>
+#include <vector>
 
 #include "checkers.h"
 
+namespace {
+
+// binary wire protocol
+//
+//  a client asks for it by sending WIRE_MAGIC followed by a version byte
+//  as soon as it connects, clients that stay silent speak text. every
+//  message after that is framed as
+//
+//      [u16 length, little endian][u8 type][length-1 bytes payload]
+//
+//  moves are one square index (0-31, bitboard_t::square) per byte and a
+//  board is three little endian masks: white, black, kings. after each
+//  opponent move the client gets the events it produced and a checksum
+//  of the resulting board, with a full board in their place every few
+//  moves to recover from any drift
+const char WIRE_MAGIC[3] = {'C', 'K', 'B'};
+const uint8_t WIRE_VERSION = 1;
+const size_t WIRE_MAX_FRAME = 128;
+// output a client may leave unread before it is treated as gone
+const size_t MAX_OUTPUT = 64 * 1024;
+// how long a silent client has to send the magic before we assume text
+const int32_t WIRE_HELLO_TIMEOUT_MS = 200;
+
+enum wire_type_e : uint8_t
+{
+    // server: handshake accepted {u8 version}
+    WIRE_HELLO = 1,
+    // server: your colour {u8 colour_e}
+    WIRE_COLOUR,
+    // server: full board {u32 white, u32 black, u32 kings}
+    WIRE_BOARD,
+    // both: a move {u8 square...}
+    WIRE_MOVE,
+    // server: it is your turn
+    WIRE_REQUEST_MOVE,
+    // server: your move was rejected {u8 square...}
+    WIRE_INVALID_MOVE,
+    // server: your message could not be parsed
+    WIRE_BAD_INPUT,
+    // server: what the opponents move changed
+    //  {u32 board checksum, {u8 event type, u8 square, u8 square}...}
+    WIRE_EVENTS,
+    // server: handshake refused, the connection is closed after it
+    //  {u8 version the server speaks}
+    WIRE_REJECT,
+};
+
+// true if the last socket call failed only because no data was ready
+bool would_block()
+{
+#if defined(_MSC_VER)
+    return WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+    return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+#endif
+}
+
+// fixed size receive buffer that the socket is drained into and
+// messages are parsed out of in place
+struct recv_ring_t
+{
+    // must be a power of two
+    static const size_t SIZE = 1024;
+
+    std::array<char, SIZE> data;
+    // free running read and write counters
+    size_t head, tail;
+    // bytes past head already searched for a message delimiter
+    size_t scanned;
+
+    recv_ring_t()
+        : head(0)
+        , tail(0)
+        , scanned(0)
+    {
+    }
+
+    size_t size() const
+    {
+        return tail - head;
+    }
+
+    bool full() const
+    {
+        return size() == SIZE;
+    }
+
+    char operator [] (size_t i) const
+    {
+        return data[(head + i) & (SIZE - 1)];
+    }
+
+    // read everything the socket has without blocking, returns false if
+    // the connection was closed or failed
+    bool fill(SOCKET sock)
+    {
+        while (!full()) {
+            // largest contiguous free region
+            const size_t offset = tail & (SIZE - 1);
+            const size_t space = std::min(SIZE - size(), SIZE - offset);
+#if defined(_MSC_VER)
+            const int ret = recv(sock, &data[offset], int(space), 0);
+#else
+            const ssize_t ret = recv(sock, &data[offset], space, MSG_DONTWAIT);
+#endif
+            if (ret > 0) {
+                METRIC_ADD(TCP_RECV_BYTES, uint64_t(ret));
+                tail += size_t(ret);
+                continue;
+            }
+            if (ret < 0 && would_block()) {
+                return true;
+            }
+            return false;
+        }
+        return true;
+    }
+
+    // length of the first complete line (excluding the newline) if any
+    bool find_line(size_t & length)
+    {
+        for (; scanned < size(); ++scanned) {
+            if ((*this)[scanned] == '\n') {
+                length = scanned;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void consume(size_t count)
+    {
+        head += count;
+        scanned = 0;
+    }
+};
+
+} // namespace {}
+
 struct tcp_player_t : public player_t
 {
 protected:
     SOCKET sock_;
+    // wire format negotiated at connect time
+    protocol_e protocol_;
+    // set once the peer has gone away
+    bool connected_;
+    // bytes received but not yet parsed
+    recv_ring_t input_;
+    // bytes the socket would not take yet, sent once it is writable
+    std::vector<char> output_;
+
+    // buffer bytes for the peer and send as much as the socket will take
+    bool queue(const void * data, size_t size)
+    {
+        if (!connected_) {
+            return false;
+        }
+        if (output_.size() + size > MAX_OUTPUT) {
+            log(LOG_WARN, "client stopped reading, dropping it");
+            connected_ = false;
+            return false;
+        }
+        const char * bytes = (const char *)data;
+        output_.insert(output_.end(), bytes, bytes + size);
+        return flush();
+    }
+
+    bool send_text(const std::string & text)
+    {
+        return queue(text.c_str(), text.length());
+    }
+
+    // send one binary frame: [u16 length][u8 type][payload]
+    bool send_frame(uint8_t type, const uint8_t * payload, size_t size)
+    {
+        std::array<uint8_t, WIRE_MAX_FRAME + 2> frame;
+        if (size + 1 > WIRE_MAX_FRAME) {
+            return false;
+        }
+        const size_t length = size + 1;
+        frame[0] = uint8_t(length);
+        frame[1] = uint8_t(length >> 8);
+        frame[2] = type;
+        if (size) {
+            memcpy(&frame[3], payload, size);
+        }
+        return queue(frame.data(), length + 2);
+    }
+
+    // send a move as one square index per byte
+    bool send_squares(uint8_t type, const move_t & move)
+    {
+        std::array<uint8_t, WIRE_MAX_FRAME> squares;
+        if (move.size() > squares.size()) {
+            return false;
+        }
+        for (size_t i = 0; i < move.size(); ++i) {
+            const int32_t sq = bitboard_t::square(move[i]);
+            if (sq == EMPTY) {
+                return false;
+            }
+            squares[i] = uint8_t(sq);
+        }
+        return send_frame(type, squares.data(), move.size());
+    }
+
+    uint8_t byte_at(size_t i) const
+    {
+        return uint8_t(input_[i]);
+    }
+
+    // true if a complete message is waiting in the ring
+    bool has_message()
+    {
+        if (protocol_ == PROTOCOL_BINARY) {
+            return input_.size() >= 2 &&
+                   input_.size() >= 2 + size_t(byte_at(0) | (byte_at(1) << 8));
+        }
+        size_t length;
+        return input_.find_line(length);
+    }
+
+    // parse a line of digit pairs "xyxy..." straight out of the ring
+    bool parse_move(size_t length, move_t & out) const
+    {
+        size_t i = 0;
+        while (i < length) {
+            const char c = input_[i];
+            // tolerate separators and windows line endings
+            if (c == ' ' || c == ',' || c == '\r') {
+                ++i;
+                continue;
+            }
+            if (i + 1 >= length) {
+                return false;
+            }
+            const pos_t p = {c - '0', input_[i + 1] - '0'};
+            if (p.x < 0 || p.x > 7 || p.y < 0 || p.y > 7) {
+                return false;
+            }
+            if (!out.push_back(p)) {
+                return false;
+            }
+            i += 2;
+        }
+        // must have two coordinates for valid move
+        return out.size() >= 2;
+    }
+
+    bool poll_text(move_t & out)
+    {
+        size_t length = 0;
+        if (!input_.find_line(length)) {
+            // a frame larger than the ring can never complete
+            if (input_.full()) {
+                input_.consume(input_.size());
+                log(LOG_WARN, "client line overflowed, dropping it");
+                connected_ = false;
+                return false;
+            }
+            // a partial message is not an error, wait for more
+            return connected_;
+        }
+        const bool valid = parse_move(length, out);
+        // drop the message and its delimiter
+        input_.consume(length + 1);
+        if (!valid) {
+            // the next line can still be read, so only tell the client
+            out.clear();
+            bad_input();
+        }
+        return connected_;
+    }
+
+    bool poll_binary(move_t & out)
+    {
+        if (input_.size() < 2) {
+            return connected_;
+        }
+        const size_t length = byte_at(0) | (byte_at(1) << 8);
+        if (length == 0 || length > WIRE_MAX_FRAME) {
+            // framing is lost so nothing after this can be trusted
+            input_.consume(input_.size());
+            log(LOG_WARN, "client frame length %u is invalid, dropping it",
+                unsigned(length));
+            connected_ = false;
+            return false;
+        }
+        if (input_.size() < 2 + length) {
+            return connected_;
+        }
+        bool valid = byte_at(2) == WIRE_MOVE && length >= 3;
+        for (size_t i = 3; valid && i < 2 + length; ++i) {
+            const uint8_t sq = byte_at(i);
+            valid = sq < 32 && out.push_back(bitboard_t::position(sq));
+        }
+        input_.consume(2 + length);
+        if (!valid) {
+            // the next frame can still be read, so only tell the client
+            out.clear();
+            bad_input();
+        }
+        return connected_;
+    }
 
 public:
-    tcp_player_t(colour_e colour, SOCKET socket_)
+    tcp_player_t(colour_e colour, SOCKET socket_, protocol_e protocol)
         : player_t(colour)
         , sock_(socket_)
+        , protocol_(protocol)
+        , connected_(true)
     {
         assert(sock_ != INVALID_SOCKET);
+#if defined(_MSC_VER)
+        // winsock has no per call MSG_DONTWAIT
+        u_long nonblocking = 1;
+        ioctlsocket(sock_, FIONBIO, &nonblocking);
+#endif
+        // acknowledge the binary handshake with the version we speak
+        if (protocol_ == PROTOCOL_BINARY) {
+            const uint8_t version = WIRE_VERSION;
+            send_frame(WIRE_HELLO, &version, 1);
+        }
+    }
+
+    virtual ~tcp_player_t()
+    {
+        // last chance for anything still buffered
+        flush();
+#if defined(_MSC_VER)
+        closesocket(sock_);
+#else
+        close(sock_);
+#endif
     }
 
     virtual bool is_connected()
     {
-        return sock_ != INVALID_SOCKET;
+        return sock_ != INVALID_SOCKET && connected_;
     }
 
     virtual bool poll_move(move_t & out)
     {
-        return false;
+        out.clear();
+        flush();
+        // drain the socket into the receive ring
+        if (connected_ && !input_.fill(sock_)) {
+            connected_ = false;
+        }
+        return protocol_ == PROTOCOL_BINARY ? poll_binary(out) : poll_text(out);
     }
 
     virtual bool invalid_move(const move_t & move)
     {
-        return false;
+        if (protocol_ == PROTOCOL_BINARY) {
+            return send_squares(WIRE_INVALID_MOVE, move);
+        }
+        std::string msg = "INVALID ";
+        if (!move.serialize(msg)) {
+            return false;
+        }
+        return send_text(msg + "\n");
     }
 
     virtual bool send_move(const move_t & move)
     {
+        if (protocol_ == PROTOCOL_BINARY) {
+            return send_squares(WIRE_MOVE, move);
+        }
         std::string state;
         move.serialize(state);
-        int ret = send(sock_, state.c_str(), state.length(), 0);
-        return ret == state.length();
+        return send_text(state);
     }
 
     virtual bool send_board(const board_t & board)
     {
+        if (protocol_ == PROTOCOL_BINARY) {
+            // three little endian masks: white, black, kings
+            const uint32_t masks[3] = {
+                board.bits.white, board.bits.black, board.bits.kings
+            };
+            std::array<uint8_t, 12> payload;
+            for (size_t i = 0; i < payload.size(); ++i) {
+                payload[i] = uint8_t(masks[i / 4] >> ((i % 4) * 8));
+            }
+            return send_frame(WIRE_BOARD, payload.data(), payload.size());
+        }
         std::string state;
         board.serialize(state);
-        int ret = send(sock_, state.c_str(), state.length(), 0);
-        return ret == state.length();
+        return send_text(state);
+    }
+
+    virtual bool send_events(const event_list_t & events,
+                             const board_t & board)
+    {
+        // text clients expect a full board after every move
+        if (protocol_ != PROTOCOL_BINARY) {
+            return send_board(board);
+        }
+        std::array<uint8_t, WIRE_MAX_FRAME> payload;
+        const uint32_t checksum = board.bits.checksum();
+        size_t size = 0;
+        for (int32_t i = 0; i < 4; ++i) {
+            payload[size++] = uint8_t(checksum >> (i * 8));
+        }
+        for (const event_t & event : events) {
+            if (size + 3 >= payload.size()) {
+                // too long to send as a delta
+                return send_board(board);
+            }
+            payload[size++] = uint8_t(event.type);
+            payload[size++] = uint8_t(bitboard_t::square(event.pos[0]));
+            payload[size++] = uint8_t(bitboard_t::square(event.pos[1]));
+        }
+        return send_frame(WIRE_EVENTS, payload.data(), size);
     }
 
     virtual bool send_colour(colour_e c)
     {
+        if (protocol_ == PROTOCOL_BINARY) {
+            const uint8_t value = uint8_t(c);
+            return send_frame(WIRE_COLOUR, &value, 1);
+        }
         const std::string colour[] = {
             "WHITE", "BLACK"
         };
         const std::string & opt = colour[c];
-        int ret = send(sock_, opt.c_str(), opt.length(), 0);
-        return ret == opt.length();
-        return true;
+        return send_text(opt);
     }
 
     virtual bool request_move()
     {
-        return false;
+        if (protocol_ == PROTOCOL_BINARY) {
+            return send_frame(WIRE_REQUEST_MOVE, nullptr, 0);
+        }
+        return send_text("MOVE\n");
     }
 
     virtual bool bad_input()
     {
-        return true;
+        if (protocol_ == PROTOCOL_BINARY) {
+            return send_frame(WIRE_BAD_INPUT, nullptr, 0);
+        }
+        return send_text("BAD\n");
+    }
+
+    virtual int wait_fd()
+    {
+        // a buffered message can be parsed without touching the socket
+        if (has_message() || !connected_) {
+            return -1;
+        }
+        return int(sock_);
+    }
+
+    virtual bool flush()
+    {
+        size_t sent = 0;
+        while (connected_ && sent < output_.size()) {
+#if defined(_MSC_VER)
+            const int ret = send(sock_, &output_[sent], int(output_.size() - sent), 0);
+#else
+            const ssize_t ret = send(sock_, &output_[sent], output_.size() - sent, MSG_DONTWAIT);
+#endif
+            if (ret > 0) {
+                METRIC_ADD(TCP_SENT_BYTES, uint64_t(ret));
+                sent += size_t(ret);
+                continue;
+            }
+            // the rest goes once the socket is writable again
+            if (ret < 0 && would_block()) {
+                break;
+            }
+            connected_ = false;
+        }
+        output_.erase(output_.begin(), output_.begin() + sent);
+        return connected_;
+    }
+
+    virtual int flush_fd()
+    {
+        return (connected_ && !output_.empty()) ? int(sock_) : -1;
     }
 };
 
@@ -97,37 +526,38 @@ struct tcp_factory_t::impl_t
     {
     }
 
-    bool start()
+    bool start(const char * address, uint16_t port)
     {
 #if defined(_MSC_VER)
         // init winsock library
         if (WSAStartup(MAKEWORD(2, 2), &wsaData)!=NO_ERROR) {
-            log("unable to init winsock");
+            log(LOG_ERROR, "unable to init winsock");
             return false;
         }
 #endif
         // create the listen socket
         ls_sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
         if (ls_sock==INVALID_SOCKET) {
-            log("unable to create the listen socket");
+            log(LOG_ERROR, "unable to create the listen socket");
             return false;
         }
 
         // bind socket to interface
         sockaddr_in service;
         service.sin_family = AF_INET;
-        if (inet_pton(AF_INET, "127.0.0.1", PVOID(&service.sin_addr.s_addr))!=1) {
-            log("unable create on-wire descriptor");
+        if (inet_pton(AF_INET, address, PVOID(&service.sin_addr.s_addr))!=1) {
+            log(LOG_ERROR, "unable create on-wire descriptor");
+            return false;
         }
-        service.sin_port = htons(1234);
+        service.sin_port = htons(port);
         if (bind(ls_sock, (SOCKADDR *)& service, sizeof(service))==SOCKET_ERROR) {
-            log("unable to bind the listen socket");
+            log(LOG_ERROR, "unable to bind the listen socket");
             return false;
         }
 
         // switch to listen state
-        if (listen(ls_sock, 2)==SOCKET_ERROR) {
-            log("unable to enter listen state");
+        if (listen(ls_sock, SOMAXCONN)==SOCKET_ERROR) {
+            log(LOG_ERROR, "unable to enter listen state");
             return false;
         }
 
@@ -136,17 +566,63 @@ struct tcp_factory_t::impl_t
 
     player_t * new_tcp_player(colour_e clr)
     {
-        // accept a new connection
-        SOCKET pl_sock = accept(ls_sock, nullptr, nullptr);
-        if (pl_sock==INVALID_SOCKET) {
-            log("bad client connect");
-            return nullptr;
-        }
-        else {
-            log("new connection");
+        for (;;) {
+            // accept a new connection
+            SOCKET pl_sock = accept(ls_sock, nullptr, nullptr);
+            if (pl_sock==INVALID_SOCKET) {
+                log(LOG_WARN, "bad client connect");
+                return nullptr;
+            }
+            else {
+                log("new connection");
+            }
+            // give the client a moment to ask for the binary protocol
+            typedef std::chrono::steady_clock steady_clock_t;
+            const auto deadline = steady_clock_t::now() +
+                                  std::chrono::milliseconds(WIRE_HELLO_TIMEOUT_MS);
+            protocol_e protocol = PROTOCOL_TEXT;
+            bool partial = false;
+            for (;;) {
+                const int64_t left = std::chrono::duration_cast<std::chrono::microseconds>(
+                    deadline - steady_clock_t::now()).count();
+                if (left <= 0) {
+                    break;
+                }
+                if (partial) {
+                    // the socket stays readable with part of the hello in it,
+                    // so wait a little for the rest rather than spin
+                    std::this_thread::sleep_for(
+                        std::chrono::microseconds(std::min<int64_t>(left, 1000)));
+                }
+                else {
+                    fd_set readable;
+                    FD_ZERO(&readable);
+                    FD_SET(pl_sock, &readable);
+                    timeval tv;
+                    tv.tv_sec = long(left / 1000000);
+                    tv.tv_usec = long(left % 1000000);
+                    if (select(int(pl_sock) + 1, &readable, nullptr, nullptr, &tv) <= 0) {
+                        continue;
+                    }
+                }
+                if (detect_protocol(intptr_t(pl_sock), protocol)) {
+                    break;
+                }
+                partial = true;
+            }
+            // a client asking for a version we do not speak has been told
+            // so, close it and wait for another
+            if (protocol == PROTOCOL_REJECTED) {
+#if defined(_MSC_VER)
+                closesocket(pl_sock);
+#else
+                close(pl_sock);
+#endif
+                continue;
+            }
+            // create the new player object
+            return new tcp_player_t(clr, pl_sock, protocol);
         }
-        // create the new player object
-        return new tcp_player_t(clr, pl_sock);
     }
 
     bool stop()
@@ -168,9 +644,9 @@ tcp_factory_t::~tcp_factory_t()
     delete imp_;
 }
 
-bool tcp_factory_t::start()
+bool tcp_factory_t::start(const char * address, uint16_t port)
 {
-    return imp_->start();
+    return imp_->start(address, port);
 }
 
 bool tcp_factory_t::stop()
@@ -182,3 +658,46 @@ player_t * tcp_factory_t::new_tcp_player(colour_e clr)
 {
     return imp_->new_tcp_player(clr);
 }
+
+bool detect_protocol(intptr_t socket, protocol_e & out)
+{
+    std::array<char, sizeof(WIRE_MAGIC) + 1> hello;
+    const int ret = recv(SOCKET(socket), hello.data(), int(hello.size()), MSG_PEEK | MSG_DONTWAIT);
+    if (ret < 0) {
+        // nothing sent yet so keep waiting, otherwise give up
+        if (would_block()) {
+            return false;
+        }
+        out = PROTOCOL_TEXT;
+        return true;
+    }
+    const size_t size = size_t(ret);
+    const size_t prefix = std::min(size, sizeof(WIRE_MAGIC));
+    if (size == 0 || memcmp(hello.data(), WIRE_MAGIC, prefix) != 0) {
+        // text clients never send the magic
+        out = PROTOCOL_TEXT;
+        return true;
+    }
+    if (size < hello.size()) {
+        // part of the hello, wait for the rest
+        return false;
+    }
+    // consume the hello now it has been recognised
+    recv(SOCKET(socket), hello.data(), int(hello.size()), 0);
+    if (uint8_t(hello[sizeof(WIRE_MAGIC)]) != WIRE_VERSION) {
+        log(LOG_WARN, "client asked for unsupported protocol version %d",
+            int(uint8_t(hello[sizeof(WIRE_MAGIC)])));
+        // tell it the version we speak, a fresh socket always has room
+        const char reject[4] = {2, 0, char(WIRE_REJECT), char(WIRE_VERSION)};
+        send(SOCKET(socket), reject, int(sizeof(reject)), MSG_DONTWAIT);
+        out = PROTOCOL_REJECTED;
+        return true;
+    }
+    out = PROTOCOL_BINARY;
+    return true;
+}
+
+player_t * new_tcp_player(colour_e colour, intptr_t socket, protocol_e protocol)
+{
+    return new tcp_player_t(colour, SOCKET(socket), protocol);
+}
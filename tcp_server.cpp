@@ -0,0 +1,609 @@
+#if defined(__linux__)
+ #include <sys/epoll.h>
+ #include <sys/eventfd.h>
+ #include <sys/socket.h>
+ #include <sys/types.h>
+ #include <netinet/in.h>
+ #include <netinet/tcp.h>
+ #include <arpa/inet.h>
+ #include <cerrno>
+ #include <csignal>
+ #include <unistd.h>
+#endif
+
+#include <chrono>
+#include <cstring>
+#include <list>
+#include <memory>
+#include <unordered_set>
+
+#include "checkers.h"
+
+#if defined(__linux__)
+
+namespace {
+
+// most readiness events handled per epoll_wait call
+const int MAX_EVENTS = 256;
+// how long a new client has to ask for the binary protocol
+const int32_t HELLO_TIMEOUT_MS = 200;
+// how long the clients of a finished match have to take their last output
+const int32_t DRAIN_TIMEOUT_MS = 2000;
+
+typedef std::chrono::steady_clock steady_clock_t;
+
+struct match_t;
+
+// a client socket registered with epoll
+struct conn_t
+{
+    int fd;
+    // tags log messages about this client
+    uint32_t id;
+    // match this client is playing in (nullptr while waiting)
+    match_t * match;
+    // wire format, settled once the handshake is over
+    protocol_e protocol;
+    bool handshaking;
+    // player of a finished match whose output is still being sent
+    player_t * draining;
+    // when a silent client is assumed to speak text, or a draining one
+    // is closed regardless
+    steady_clock_t::time_point deadline;
+    // position in the handshake or drain queue
+    std::list<conn_t *>::iterator queued;
+};
+
+// two paired clients and the game they are playing
+struct match_t
+{
+    // tags log messages about this game
+    uint32_t id;
+    std::array<conn_t *, 2> conn;
+    std::array<player_t *, 2> players;
+    std::unique_ptr<checkers_t> game;
+    // renderer drawing the game (may be nullptr)
+    render_t * render;
+    // set once the match has been torn down this loop iteration
+    bool closed;
+};
+
+} // namespace {}
+
+struct tcp_server_t::impl_t
+{
+    int listen_fd;
+    int epoll_fd;
+    // written to by stop() to wake the event loop
+    int wake_fd;
+    std::atomic<bool> running;
+    // markers used as epoll user data for the listen and wake sockets
+    conn_t listen_conn;
+    conn_t wake_conn;
+    // clients still negotiating their wire format, oldest first
+    std::list<conn_t *> handshakes;
+    // clients of finished matches being sent their last output, oldest
+    // first
+    std::list<conn_t *> drains;
+    // client waiting for an opponent
+    conn_t * waiting;
+    // matches in progress
+    std::unordered_set<match_t *> matches;
+    // matches closed during this loop iteration, freed once it ends
+    std::vector<match_t *> dead;
+    // finished games are appended here when recording
+    pdn_writer_t recorder;
+    bool recording;
+    // renderers for spectated games (may be nullptr)
+    render_pool_t * spectators;
+    // last id handed to a connection or match
+    uint32_t last_conn_id;
+    uint32_t last_match_id;
+
+    impl_t()
+        : listen_fd(-1)
+        , epoll_fd(-1)
+        , wake_fd(-1)
+        , running(false)
+        , waiting(nullptr)
+        , recording(false)
+        , spectators(nullptr)
+        , last_conn_id(0)
+        , last_match_id(0)
+    {
+    }
+
+    ~impl_t()
+    {
+        for (match_t * m : matches) {
+            close_match(m);
+        }
+        reap();
+        for (conn_t * c : drains) {
+            delete c->draining;
+            delete c;
+        }
+        for (conn_t * c : handshakes) {
+            close(c->fd);
+            delete c;
+        }
+        if (waiting) {
+            close(waiting->fd);
+            delete waiting;
+        }
+        if (listen_fd >= 0) {
+            close(listen_fd);
+        }
+        if (wake_fd >= 0) {
+            close(wake_fd);
+        }
+        if (epoll_fd >= 0) {
+            close(epoll_fd);
+        }
+    }
+
+    bool watch(int fd, uint32_t events, conn_t * conn)
+    {
+        epoll_event ev;
+        ev.events = events;
+        ev.data.ptr = conn;
+        return epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) == 0;
+    }
+
+    bool start(const char * address, uint16_t port)
+    {
+        // a client vanishing mid send must not kill the server
+        signal(SIGPIPE, SIG_IGN);
+
+        epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+        wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (epoll_fd < 0 || wake_fd < 0) {
+            log(LOG_ERROR, "unable to create the event loop");
+            return false;
+        }
+
+        // create the listen socket
+        listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, IPPROTO_TCP);
+        if (listen_fd < 0) {
+            log(LOG_ERROR, "unable to create the listen socket");
+            return false;
+        }
+        const int one = 1;
+        setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+        // bind socket to interface
+        sockaddr_in service;
+        memset(&service, 0, sizeof(service));
+        service.sin_family = AF_INET;
+        if (inet_pton(AF_INET, address, &service.sin_addr.s_addr) != 1) {
+            log(LOG_ERROR, "unable to parse bind address '%s'", address);
+            return false;
+        }
+        service.sin_port = htons(port);
+        if (bind(listen_fd, (sockaddr *)&service, sizeof(service)) != 0) {
+            log(LOG_ERROR, "unable to bind the listen socket to %s:%d", address, int(port));
+            return false;
+        }
+
+        // switch to listen state
+        if (listen(listen_fd, SOMAXCONN) != 0) {
+            log(LOG_ERROR, "unable to enter listen state");
+            return false;
+        }
+
+        listen_conn.fd = listen_fd;
+        listen_conn.match = nullptr;
+        wake_conn.fd = wake_fd;
+        wake_conn.match = nullptr;
+        if (!watch(listen_fd, EPOLLIN | EPOLLET, &listen_conn) ||
+            !watch(wake_fd, EPOLLIN | EPOLLET, &wake_conn)) {
+            log(LOG_ERROR, "unable to register with epoll");
+            return false;
+        }
+        log("listening on %s:%d", address, int(port));
+        running = true;
+        return true;
+    }
+
+    bool record(const char * path)
+    {
+        recording = recorder.open(path);
+        if (!recording) {
+            log(LOG_ERROR, "unable to open '%s' to record games", path);
+        }
+        return recording;
+    }
+
+    bool spectate(render_pool_t * pool)
+    {
+        spectators = pool;
+        return true;
+    }
+
+    // run a game until it stalls waiting for input, false once it is over
+    bool pump(match_t * m)
+    {
+        checkers_t & game = *m->game;
+        while (game.is_active()) {
+            const int32_t before = game.plies();
+            // bad input has been reported to the player and is passed over
+            // like an invalid move, a player that has gone away ends it
+            game.poll_players();
+            // events are edge triggered, so keep going while the player to
+            // move, who may be the next one, has more buffered
+            if (game.plies() == before && !game.player_ready()) {
+                break;
+            }
+        }
+        return game.is_active();
+    }
+
+    // start a game between the waiting client and a new one
+    void pair(conn_t * a, conn_t * b)
+    {
+        match_t * m = new match_t;
+        m->id = ++last_match_id;
+        log_scope_t scope(m->id, b->id);
+        m->conn = {a, b};
+        m->players = {
+            new_tcp_player(BLACK, a->fd, a->protocol),
+            new_tcp_player(WHITE, b->fd, b->protocol),
+        };
+        m->closed = false;
+        a->match = m;
+        b->match = m;
+        m->render = spectators ? spectators->acquire() : nullptr;
+        m->game.reset(new checkers_t(m->players,
+                                     m->render,
+                                     recording ? &recorder : nullptr));
+        matches.insert(m);
+        log("match started between conn %u and %u (%d in progress)",
+            a->id, b->id, int(matches.size()));
+        // the first player may have sent a move before we were watching
+        if (!pump(m)) {
+            close_match(m);
+        }
+    }
+
+    // accept every pending connection (edge triggered)
+    void accept_clients()
+    {
+        for (;;) {
+            const int fd = accept4(listen_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (fd < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                    log(LOG_ERROR, "accept failed (errno %d)", errno);
+                }
+                return;
+            }
+            const int one = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+            conn_t * conn = new conn_t;
+            conn->fd = fd;
+            conn->id = ++last_conn_id;
+            conn->match = nullptr;
+            conn->protocol = PROTOCOL_TEXT;
+            conn->handshaking = true;
+            conn->draining = nullptr;
+            conn->deadline = steady_clock_t::now() +
+                             std::chrono::milliseconds(HELLO_TIMEOUT_MS);
+            if (!watch(fd, EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET, conn)) {
+                log(LOG_ERROR, "unable to watch client socket");
+                close(fd);
+                delete conn;
+                continue;
+            }
+            conn->queued = handshakes.insert(handshakes.end(), conn);
+            log_scope_t scope(0, conn->id);
+            log(LOG_DEBUG, "new connection");
+        }
+    }
+
+    // a client has settled on a wire format so find it an opponent
+    void handshake_done(conn_t * conn)
+    {
+        handshakes.erase(conn->queued);
+        conn->handshaking = false;
+        if (waiting) {
+            conn_t * other = waiting;
+            waiting = nullptr;
+            pair(other, conn);
+        }
+        else {
+            waiting = conn;
+        }
+    }
+
+    // assume text for clients that stayed silent too long
+    void expire_handshakes()
+    {
+        const auto now = steady_clock_t::now();
+        while (!handshakes.empty() && handshakes.front()->deadline <= now) {
+            conn_t * conn = handshakes.front();
+            conn->protocol = PROTOCOL_TEXT;
+            handshake_done(conn);
+        }
+    }
+
+    // milliseconds until the next handshake or drain expires (-1 for
+    // never)
+    int next_timeout() const
+    {
+        if (handshakes.empty() && drains.empty()) {
+            return -1;
+        }
+        steady_clock_t::time_point next = steady_clock_t::time_point::max();
+        if (!handshakes.empty()) {
+            next = handshakes.front()->deadline;
+        }
+        if (!drains.empty()) {
+            next = std::min(next, drains.front()->deadline);
+        }
+        const auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+            next - steady_clock_t::now()).count();
+        // round up so we never wake just before the deadline
+        return left < 0 ? 0 : int(left) + 1;
+    }
+
+    // keep a client of a finished match open until it has been sent what
+    // is buffered for it, then close gracefully so it can read to the end
+    void drain(conn_t * conn, player_t * p)
+    {
+        conn->match = nullptr;
+        conn->draining = p;
+        conn->deadline = steady_clock_t::now() +
+                         std::chrono::milliseconds(DRAIN_TIMEOUT_MS);
+        conn->queued = drains.insert(drains.end(), conn);
+        // edge triggered, so a socket that is already writable reports it
+        if (!watch(conn->fd, EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET, conn)) {
+            end_drain(conn);
+        }
+    }
+
+    // send more of a draining client's output, and close it once all of
+    // it has gone and the client has closed its end too
+    void pump_drain(conn_t * conn, uint32_t events)
+    {
+        // unread input would turn our close into a reset, losing output
+        // the client has yet to read, so discard it
+        char discard[256];
+        ssize_t ret;
+        while ((ret = recv(conn->fd, discard, sizeof(discard), MSG_DONTWAIT)) > 0) {
+        }
+        // a client that has only stopped sending may still be reading
+        const bool finished = ret == 0;
+        const bool failed = (events & (EPOLLHUP | EPOLLERR)) != 0;
+        if (failed || !conn->draining->flush()) {
+            end_drain(conn);
+        }
+        else if (conn->draining->flush_fd() < 0) {
+            if (finished) {
+                end_drain(conn);
+            }
+            else {
+                shutdown(conn->fd, SHUT_WR);
+            }
+        }
+    }
+
+    void end_drain(conn_t * conn)
+    {
+        drains.erase(conn->queued);
+        epoll_ctl(epoll_fd, EPOLL_CTL_DEL, conn->fd, nullptr);
+        // the player owns and closes the socket
+        delete conn->draining;
+        delete conn;
+    }
+
+    // close clients that are taking too long to read their last output
+    void expire_drains()
+    {
+        const auto now = steady_clock_t::now();
+        while (!drains.empty() && drains.front()->deadline <= now) {
+            end_drain(drains.front());
+        }
+    }
+
+    // tear down a match, its memory is released by reap()
+    void close_match(match_t * m)
+    {
+        if (m->closed) {
+            return;
+        }
+        m->closed = true;
+        for (conn_t * c : m->conn) {
+            epoll_ctl(epoll_fd, EPOLL_CTL_DEL, c->fd, nullptr);
+        }
+        dead.push_back(m);
+    }
+
+    // free matches closed during the last batch of events
+    void reap()
+    {
+        for (match_t * m : dead) {
+            matches.erase(m);
+            // players own and close their sockets, the last output to a
+            // client still there is sent before its socket is closed
+            for (size_t i = 0; i < m->conn.size(); ++i) {
+                conn_t * c = m->conn[i];
+                player_t * p = m->players[i];
+                if (p->is_connected() && running) {
+                    drain(c, p);
+                }
+                else {
+                    delete p;
+                    delete c;
+                }
+            }
+            // the game must be gone before its renderer is reused
+            log_scope_t scope(m->id, 0);
+            m->game.reset();
+            if (m->render) {
+                spectators->release(m->render);
+            }
+            delete m;
+        }
+        if (!dead.empty()) {
+            log("match ended (%d in progress)", int(matches.size()));
+        }
+        dead.clear();
+    }
+
+    void on_client(conn_t * conn, uint32_t events)
+    {
+        match_t * m = conn->match;
+        log_scope_t scope(m ? m->id : 0, conn->id);
+        const bool hangup = (events & (EPOLLRDHUP | EPOLLHUP | EPOLLERR)) != 0;
+        if (conn->draining) {
+            pump_drain(conn, events);
+            return;
+        }
+        if (conn->handshaking) {
+            const bool done = !hangup && detect_protocol(conn->fd, conn->protocol);
+            // a client we refused has been told why and is dropped too
+            if (hangup || (done && conn->protocol == PROTOCOL_REJECTED)) {
+                handshakes.erase(conn->queued);
+                epoll_ctl(epoll_fd, EPOLL_CTL_DEL, conn->fd, nullptr);
+                close(conn->fd);
+                delete conn;
+            }
+            else if (done) {
+                handshake_done(conn);
+            }
+            return;
+        }
+        if (!m) {
+            // a waiting client left before being paired
+            if (hangup && conn == waiting) {
+                epoll_ctl(epoll_fd, EPOLL_CTL_DEL, conn->fd, nullptr);
+                close(conn->fd);
+                delete conn;
+                waiting = nullptr;
+            }
+            return;
+        }
+        if (m->closed) {
+            return;
+        }
+        // the socket can take output a slow reader left buffered
+        bool flushed = true;
+        if (events & EPOLLOUT) {
+            player_t * p = (m->conn[0] == conn) ? m->players[0] : m->players[1];
+            flushed = p->flush();
+        }
+        if (hangup || !flushed || !pump(m)) {
+            close_match(m);
+        }
+    }
+
+    bool run()
+    {
+        std::array<epoll_event, MAX_EVENTS> events;
+        while (running) {
+            const int n = epoll_wait(epoll_fd, events.data(), MAX_EVENTS, next_timeout());
+            if (n < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                log(LOG_ERROR, "epoll_wait failed (errno %d)", errno);
+                return false;
+            }
+            for (int i = 0; i < n; ++i) {
+                conn_t * conn = (conn_t *)events[i].data.ptr;
+                if (conn == &listen_conn) {
+                    accept_clients();
+                }
+                else if (conn == &wake_conn) {
+                    uint64_t value;
+                    while (read(wake_fd, &value, sizeof(value)) > 0) {
+                    }
+                }
+                else {
+                    on_client(conn, events[i].events);
+                }
+            }
+            expire_handshakes();
+            reap();
+            expire_drains();
+        }
+        return true;
+    }
+
+    bool stop()
+    {
+        running = false;
+        const uint64_t one = 1;
+        return write(wake_fd, &one, sizeof(one)) == sizeof(one);
+    }
+};
+
+#else
+
+struct tcp_server_t::impl_t
+{
+    bool start(const char *, uint16_t)
+    {
+        log(LOG_ERROR, "the game server requires epoll (linux only)");
+        return false;
+    }
+
+    bool record(const char *)
+    {
+        return false;
+    }
+
+    bool spectate(render_pool_t *)
+    {
+        return false;
+    }
+
+    bool run()
+    {
+        return false;
+    }
+
+    bool stop()
+    {
+        return false;
+    }
+};
+
+#endif
+
+tcp_server_t::tcp_server_t()
+    : imp_(new tcp_server_t::impl_t)
+{
+}
+
+tcp_server_t::~tcp_server_t()
+{
+    delete imp_;
+}
+
+bool tcp_server_t::start(const char * address, uint16_t port)
+{
+    return imp_->start(address, port);
+}
+
+bool tcp_server_t::record(const char * pdn_path)
+{
+    return imp_->record(pdn_path);
+}
+
+bool tcp_server_t::spectate(render_pool_t * pool)
+{
+    return imp_->spectate(pool);
+}
+
+bool tcp_server_t::run()
+{
+    return imp_->run();
+}
+
+bool tcp_server_t::stop()
+{
+    return imp_->stop();
+}
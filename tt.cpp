@@ -0,0 +1,131 @@
+#include "checkers.h"
+
+namespace {
+
+// packed entry layout
+//
+//  [0,16)  score
+//  [16,24) depth
+//  [24,26) bound
+//  [26,31) best move start square
+//  [31,36) best move destination square
+//  [36,44) age
+uint64_t pack(const tt_t::hit_t & in, uint8_t age)
+{
+    return  uint64_t(uint16_t(int16_t(in.score)))
+         | (uint64_t(uint8_t(in.depth)) << 16)
+         | (uint64_t(in.bound & 3) << 24)
+         | (uint64_t(in.from & 31) << 26)
+         | (uint64_t(in.to & 31) << 31)
+         | (uint64_t(age) << 36);
+}
+
+void unpack(uint64_t data, tt_t::hit_t & out)
+{
+    out.score = int16_t(uint16_t(data));
+    out.depth = int8_t(uint8_t(data >> 16));
+    out.bound = tt_t::bound_e((data >> 24) & 3);
+    out.from = uint8_t((data >> 26) & 31);
+    out.to = uint8_t((data >> 31) & 31);
+}
+
+uint8_t entry_age(uint64_t data)
+{
+    return uint8_t(data >> 36);
+}
+
+} // namespace {}
+
+tt_t::tt_t()
+    : entries(nullptr)
+    , mask(0)
+    , age(0)
+{
+}
+
+tt_t::~tt_t()
+{
+    delete [] entries;
+}
+
+bool tt_t::resize(size_t mb)
+{
+    // largest power of two bucket count that fits the budget
+    const size_t bytes = mb * 1024 * 1024;
+    const size_t bucket_bytes = sizeof(entry_t) * BUCKET_SIZE;
+    size_t buckets = 1;
+    while (buckets * 2 * bucket_bytes <= bytes) {
+        buckets *= 2;
+    }
+    delete [] entries;
+    entries = new entry_t[buckets * BUCKET_SIZE];
+    mask = buckets - 1;
+    clear();
+    return true;
+}
+
+void tt_t::clear()
+{
+    if (!entries) {
+        return;
+    }
+    for (size_t i = 0; i < (mask+1) * BUCKET_SIZE; ++i) {
+        entries[i].check.store(0, std::memory_order_relaxed);
+        entries[i].data.store(0, std::memory_order_relaxed);
+    }
+    age = 0;
+}
+
+void tt_t::new_search()
+{
+    ++age;
+}
+
+bool tt_t::probe(uint64_t key, hit_t & out) const
+{
+    if (!entries) {
+        return false;
+    }
+    const entry_t * bucket = entries + (key & mask) * BUCKET_SIZE;
+    for (size_t i = 0; i < BUCKET_SIZE; ++i) {
+        const uint64_t data = bucket[i].data.load(std::memory_order_relaxed);
+        const uint64_t check = bucket[i].check.load(std::memory_order_relaxed);
+        // a mismatch means another key or a torn write
+        if ((check ^ data) == key && data) {
+            unpack(data, out);
+            return true;
+        }
+    }
+    return false;
+}
+
+void tt_t::store(uint64_t key, const hit_t & in)
+{
+    if (!entries) {
+        return;
+    }
+    entry_t * bucket = entries + (key & mask) * BUCKET_SIZE;
+    entry_t * victim = bucket;
+    int32_t victim_value = INT32_MAX;
+    for (size_t i = 0; i < BUCKET_SIZE; ++i) {
+        const uint64_t data = bucket[i].data.load(std::memory_order_relaxed);
+        const uint64_t check = bucket[i].check.load(std::memory_order_relaxed);
+        // always overwrite the same position
+        if ((check ^ data) == key) {
+            victim = bucket + i;
+            break;
+        }
+        // otherwise replace the shallowest entry, preferring stale ones
+        hit_t hit;
+        unpack(data, hit);
+        const int32_t value = hit.depth -
+            (entry_age(data) != age ? 256 : 0);
+        if (value < victim_value) {
+            victim_value = value;
+            victim = bucket + i;
+        }
+    }
+    const uint64_t data = pack(in, age);
+    victim->check.store(key ^ data, std::memory_order_relaxed);
+    victim->data.store(data, std::memory_order_relaxed);
+}
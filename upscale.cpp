@@ -0,0 +1,156 @@
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+ #define UPSCALE_X86 1
+ #include <immintrin.h>
+#endif
+
+#if defined(UPSCALE_X86) && !defined(_MSC_VER)
+ // let one function use instructions the rest of the build may not
+ #define TARGET(isa) __attribute__((target(isa)))
+#else
+ #define TARGET(isa)
+#endif
+
+#include "checkers.h"
+
+namespace {
+
+// copy the first of four output rows over the other three, which
+// memcpy does with the widest stores the cpu has
+void repeat_row(uint32_t * dst, size_t dst_pitch, uint32_t width)
+{
+    for (size_t r = 1; r < 4; ++r) {
+        memcpy(dst + r*dst_pitch, dst, width * 4 * sizeof(uint32_t));
+    }
+}
+
+void upscale_scalar(const uint32_t * src,
+                    size_t src_pitch,
+                    uint32_t * dst,
+                    size_t dst_pitch,
+                    uint32_t width,
+                    uint32_t height)
+{
+    for (uint32_t y = 0; y < height; ++y) {
+        for (uint32_t x = 0; x < width; ++x) {
+            const uint32_t c = src[x];
+            dst[x*4+0] = c;
+            dst[x*4+1] = c;
+            dst[x*4+2] = c;
+            dst[x*4+3] = c;
+        }
+        repeat_row(dst, dst_pitch, width);
+        src += src_pitch;
+        dst += dst_pitch * 4;
+    }
+}
+
+#if defined(UPSCALE_X86)
+
+TARGET("sse2")
+void upscale_sse2(const uint32_t * src,
+                  size_t src_pitch,
+                  uint32_t * dst,
+                  size_t dst_pitch,
+                  uint32_t width,
+                  uint32_t height)
+{
+    for (uint32_t y = 0; y < height; ++y) {
+        uint32_t x = 0;
+        // four source pixels become four 16 byte runs
+        for (; x + 4 <= width; x += 4) {
+            const __m128i v = _mm_loadu_si128((const __m128i *)(src + x));
+            __m128i * out = (__m128i *)(dst + x*4);
+            _mm_storeu_si128(out + 0, _mm_shuffle_epi32(v, 0x00));
+            _mm_storeu_si128(out + 1, _mm_shuffle_epi32(v, 0x55));
+            _mm_storeu_si128(out + 2, _mm_shuffle_epi32(v, 0xaa));
+            _mm_storeu_si128(out + 3, _mm_shuffle_epi32(v, 0xff));
+        }
+        for (; x < width; ++x) {
+            _mm_storeu_si128((__m128i *)(dst + x*4),
+                             _mm_set1_epi32(int32_t(src[x])));
+        }
+        repeat_row(dst, dst_pitch, width);
+        src += src_pitch;
+        dst += dst_pitch * 4;
+    }
+}
+
+TARGET("avx2")
+void upscale_avx2(const uint32_t * src,
+                  size_t src_pitch,
+                  uint32_t * dst,
+                  size_t dst_pitch,
+                  uint32_t width,
+                  uint32_t height)
+{
+    // lane indices that spread each pair of pixels over eight lanes
+    const __m256i i0 = _mm256_setr_epi32(0, 0, 0, 0, 1, 1, 1, 1);
+    const __m256i i1 = _mm256_setr_epi32(2, 2, 2, 2, 3, 3, 3, 3);
+    const __m256i i2 = _mm256_setr_epi32(4, 4, 4, 4, 5, 5, 5, 5);
+    const __m256i i3 = _mm256_setr_epi32(6, 6, 6, 6, 7, 7, 7, 7);
+    for (uint32_t y = 0; y < height; ++y) {
+        uint32_t x = 0;
+        // eight source pixels become four 32 byte runs
+        for (; x + 8 <= width; x += 8) {
+            const __m256i v = _mm256_loadu_si256((const __m256i *)(src + x));
+            __m256i * out = (__m256i *)(dst + x*4);
+            _mm256_storeu_si256(out + 0, _mm256_permutevar8x32_epi32(v, i0));
+            _mm256_storeu_si256(out + 1, _mm256_permutevar8x32_epi32(v, i1));
+            _mm256_storeu_si256(out + 2, _mm256_permutevar8x32_epi32(v, i2));
+            _mm256_storeu_si256(out + 3, _mm256_permutevar8x32_epi32(v, i3));
+        }
+        for (; x < width; ++x) {
+            _mm_storeu_si128((__m128i *)(dst + x*4),
+                             _mm_set1_epi32(int32_t(src[x])));
+        }
+        repeat_row(dst, dst_pitch, width);
+        src += src_pitch;
+        dst += dst_pitch * 4;
+    }
+}
+
+#endif // defined(UPSCALE_X86)
+
+} // namespace {}
+
+upscale_t::fn_t upscale_t::get(isa_e isa)
+{
+    switch (isa) {
+    case (SCALAR):
+        return upscale_scalar;
+#if defined(UPSCALE_X86)
+    case (SSE2):
+        return cpu_t::sse2() ? upscale_sse2 : nullptr;
+    case (AVX2):
+        return cpu_t::avx2() ? upscale_avx2 : nullptr;
+#endif
+    default:
+        return nullptr;
+    }
+}
+
+upscale_t::fn_t upscale_t::best()
+{
+    for (int32_t isa = NUM_ISA - 1; isa > SCALAR; --isa) {
+        if (fn_t fn = get(isa_e(isa))) {
+            return fn;
+        }
+    }
+    return upscale_scalar;
+}
+
+const char * upscale_t::name(isa_e isa)
+{
+    switch (isa) {
+    case (SCALAR):
+        return "scalar";
+    case (SSE2):
+        return "sse2";
+    case (AVX2):
+        return "avx2";
+    default:
+        return "unknown";
+    }
+}
@@ -0,0 +1,66 @@
+#include "checkers.h"
+
+uint64_t zobrist_t::keys[2][2][32];
+uint64_t zobrist_t::side_key;
+
+namespace {
+
+// splitmix64 generator, seeded identically on every run so that hashes
+// stored on disk stay valid
+uint64_t next_key(uint64_t & state)
+{
+    uint64_t z = (state += 0x9e3779b97f4a7c15ull);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+}
+
+struct zobrist_init_t
+{
+    zobrist_init_t()
+    {
+        uint64_t state = 0x636865636b657273ull;
+        for (auto & colour : zobrist_t::keys) {
+            for (auto & type : colour) {
+                for (uint64_t & key : type) {
+                    key = next_key(state);
+                }
+            }
+        }
+        zobrist_t::side_key = next_key(state);
+    }
+} zobrist_init;
+
+} // namespace {}
+
+uint64_t zobrist_t::hash(const bitboard_t & bits)
+{
+    uint64_t out = 0;
+    for (uint32_t m = bits.white | bits.black; m; m &= m-1) {
+        const int32_t sq = bitboard_t::lsb(m);
+        const uint32_t bit = 1u << sq;
+        out ^= piece((bits.white & bit) ? WHITE : BLACK,
+                     (bits.kings & bit) != 0,
+                     sq);
+    }
+    return out;
+}
+
+uint64_t zobrist_t::delta(const bitboard_t & before,
+                          const bitmove_t & move,
+                          colour_e turn)
+{
+    const colour_e other = (turn == WHITE) ? BLACK : WHITE;
+    const uint32_t from = 1u << move.from;
+    const uint32_t to = 1u << move.to();
+    const bool crowned = (before.kings & from) != 0;
+    // lift the piece and place it on its destination
+    uint64_t out = piece(turn, crowned, move.from);
+    out ^= piece(turn, crowned || (to & bitboard_t::crown_row(turn)), move.to());
+    // remove the captured pieces
+    for (uint32_t m = move.taken; m; m &= m-1) {
+        const int32_t sq = bitboard_t::lsb(m);
+        out ^= piece(other, (before.kings & (1u << sq)) != 0, sq);
+    }
+    return out ^ side_key;
+}